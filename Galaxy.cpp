@@ -1,315 +1,2738 @@
 #include "galaxy.h"
+#include "output.h"
+#include "route_matrix.h"
+#include "transfer_patterns.h"
+#include <charconv>
 
 using namespace std;
 
 //**********************************************START OF READER CLASS**********************************************//
 
+/*
+Precondition: None
+Postcondition: Returns the next line without its line break
+Splits the next line off the front of text. A trailing carriage return (DOS line ends) is dropped. 
+*/
+static string_view next_line(string_view& text)
+{
+	size_t end = text.find('\n');
+	string_view line = text.substr(0, end);
+	text.remove_prefix(end == string_view::npos ? text.size() : end + 1);
+	if (!line.empty() && line.back() == '\r') {
+		line.remove_suffix(1);
+	}
+	return line;
+}
+
+/*
+Precondition: None
+Postcondition: Returns the next tab-separated field
+Splits the next field off the front of line. 
+*/
+static string_view next_field(string_view& line)
+{
+	size_t end = line.find('\t');
+	string_view field = line.substr(0, end);
+	line.remove_prefix(end == string_view::npos ? line.size() : end + 1);
+	return field;
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the whole field is a number
+Surrounding blanks are allowed, as they were with stoi(). 
+*/
+static bool parse_number(string_view field, int& value)
+{
+	while (!field.empty() && (field.front() == ' ' || field.front() == '\t')) {
+		field.remove_prefix(1);
+	}
+	while (!field.empty() && (field.back() == ' ' || field.back() == '\t')) {
+		field.remove_suffix(1);
+	}
+	auto result = from_chars(field.data(), field.data() + field.size(), value);
+	return result.ec == errc() && result.ptr == field.data() + field.size();
+}
+
 /* 
 Precondition: None
 Postcondition: None
-Dumps out the time schedule dump from the conduits.txt
+Dumps out the time schedule dump from the conduits.txt
+*/
+void Reader::timeScheduleDump()
+{
+	for (auto const &ent : travelTimes) { //Iterates through the pairs of planet names 
+		auto const &outerKey = name_list[ent.first >> 32];
+		auto const &innerKey = name_list[ent.first & 0xffffffff];
+		cerr << "First: " << outerKey << ", Second: " << innerKey << ", Weight: " << ent.second << endl;
+	}
+}
+
+/*
+Precondition: None
+Postcondition: None
+Creates the time schedule. 
+Creates the graph while validating with the time schedule. 
+Returns the graph.
+*/
+Galaxy * Reader::load()
+{
+	if (!inFile.is_open() || !route.is_open()) {
+		cerr << "Cannot read " << (inFile.is_open() ? routes_path : conduits_path) << endl;
+		exit(EXIT_FAILURE);
+	}
+	GalaxyStats& stats = galaxy->stats;
+	{
+		PhaseTimer timer(stats.conduits_seconds);
+		createTimeSchedule();
+	}
+	{
+		PhaseTimer timer(stats.routes_seconds);
+		createGraph();
+	}
+	{
+		PhaseTimer timer(stats.freeze_seconds);
+		galaxy->freeze();
+	}
+	return galaxy;
+}
+
+/*
+Precondition: None
+Postcondition: Returns the name id
+Looks the name up in the hash table, assigning the next id to a new name. 
+*/
+int Reader::intern(string_view name)
+{
+	auto found = names.emplace(name, name_list.size());
+	if (found.second) {
+		name_list.push_back(name);
+		planets.push_back(nullptr);
+	}
+	return found.first->second;
+}
+
+/*
+Precondition: name is an id returned by intern()
+Postcondition: Returns the planet
+Creates the planet the first time its name appears in a route. 
+*/
+Planet * Reader::planet(int name)
+{
+	if (!planets[name]) {
+		planets[name] = galaxy->arena.make<Planet>(string(name_list[name]));
+	}
+	return planets[name];
+}
+
+/*
+Precondition: None
+Postcondition: None
+Creates time schedule from conduits. Utilized for validating the creation
+of the graph. Each line is: planet, planet, hours. 
+*/
+void Reader::createTimeSchedule()
+{
+	string_view text = inFile.view();
+	int line = 0;
+	while (!text.empty()) {
+		string_view fields = next_line(text);
+		line++;
+		if (fields.empty()) {
+			continue;
+		}
+		string_view startPlanet, endPlanet;
+		int weight;
+		if (!parse_conduit(fields, startPlanet, endPlanet, weight)) {
+			cerr << "Invalid input. Line " << line << " of " << conduits_path << " is not well-formed!" << endl;
+			exit(EXIT_FAILURE);
+		}
+		int start = intern(startPlanet);
+		int end = intern(endPlanet);
+		travelTimes[pair_key(end, start)] = weight;
+		travelTimes[pair_key(start, end)] = weight;
+	}
+	STAT_ADD(galaxy->stats.bytes_parsed, inFile.size());
+	STAT_ADD(galaxy->stats.lines_parsed, line);
+}
+
+/*
+Precondition: None
+Postcondition: Returns the name id or -1
+Safe to call from several threads while no names are added. 
+*/
+int Reader::lookup(string_view name) const
+{
+	auto found = names.find(name);
+	return found == names.end() ? -1 : found->second;
+}
+
+/*
+Precondition: offset is the start of a line of the routes file
+Postcondition: Returns the line without its line break
+*/
+string_view Reader::line_at(size_t offset) const
+{
+	string_view text = route.view().substr(offset);
+	return next_line(text);
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the line is well-formed
+Each line is: planet, planet, hours, separated by tabs. 
+*/
+bool Reader::parse_conduit(string_view line, string_view & start, string_view & end, int & hours)
+{
+	start = next_field(line);
+	end = next_field(line);
+	return parse_number(next_field(line), hours);
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the line is well-formed
+Each line is: ship, departure planet, departure time, destination planet, arrival time, separated 
+by tabs. 
+*/
+bool Reader::parse_leg(string_view line, string_view & ship, string_view & departure,
+	string_view & destination, Time & departure_time, Time & arrival_time)
+{
+	ship = next_field(line);
+	departure = next_field(line);
+	string_view dept = next_field(line);
+	destination = next_field(line);
+	string_view arrival = next_field(line);
+	return !ship.empty() && !departure.empty() && !destination.empty() &&
+		parse_number(dept, departure_time) && parse_number(arrival, arrival_time);
+}
+
+/*
+Precondition: None
+Postcondition: The chunk holds its records, problems and line count
+Skips blank lines and comments. Only reads the galaxy's name tables, so chunks may be parsed 
+concurrently. 
+*/
+void Reader::parse(Chunk & chunk) const
+{
+	string_view text = route.view().substr(chunk.begin, chunk.end - chunk.begin);
+	chunk.lines = 0;
+	string_view previous_ship;
+	while (!text.empty()) {
+		size_t offset = chunk.end - text.size();
+		string_view line = next_line(text);
+		chunk.lines++;
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		string_view ship, departure, destination;
+		Record record;
+		if (!parse_leg(line, ship, departure, destination, record.departure_time, record.arrival_time)) {
+			chunk.problems.push_back(Problem{ chunk.lines, "is not well-formed!" });
+			continue;
+		}
+		record.offset = offset;
+		record.line = chunk.lines;
+		record.departure_name = lookup(departure);
+		record.destination_name = lookup(destination);
+		record.ship = -1;
+		record.continues = !chunk.records.empty() && ship == previous_ship;
+		if (chunk.records.empty()) {
+			chunk.first_ship = ship;
+		}
+		chunk.records.push_back(record);
+		previous_ship = ship;
+	}
+	chunk.last_ship = previous_ship;
+}
+
+/*
+Precondition: previous is the ship's leg on the line before current
+Postcondition: Returns an empty string if the leg is valid, otherwise the reason
+*/
+string Reader::validate(const Record & previous, const Record & current) const
+{
+	string_view ship, departure, destination, previous_departure, previous_destination;
+	Time departure_time, arrival_time;
+	auto travel = travelTimes.find(pair_key(current.departure_name, current.destination_name));
+	bool conduit = current.departure_name >= 0 && current.destination_name >= 0 && travel != travelTimes.end();
+	if (conduit && current.departure_time + travel->second == current.arrival_time &&
+		previous.arrival_time + MIN_LAYOVER_TIME <= current.departure_time &&
+		previous.destination_name == current.departure_name) {
+		return string();
+	}
+	//Invalid, so worth parsing the lines again for the names. 
+	parse_leg(line_at(current.offset), ship, departure, destination, departure_time, arrival_time);
+	parse_leg(line_at(previous.offset), ship, previous_departure, previous_destination, departure_time, arrival_time);
+	if (!conduit) { //No conduit between the two planets. 
+		return "there is no conduit from " + string(departure) + " to " + string(destination);
+	}
+	if (current.departure_time + travel->second != current.arrival_time) { //Takes the wrong amount of time. 
+		return "the flight takes " + to_string(current.arrival_time - current.departure_time) + " hours instead of " +
+			to_string(travel->second);
+	}
+	if (previous.arrival_time + MIN_LAYOVER_TIME > current.departure_time) { //Minimum layover not waited. 
+		return "the ship arrived at hour " + to_string(previous.arrival_time) + " and needs " +
+			to_string(MIN_LAYOVER_TIME) + " hours before leaving";
+	}
+	return "the ship is at " + string(previous_destination) + ", not " + string(departure); //Leaves from the wrong planet. 
+}
+
+/*
+Precondition: None
+Postcondition: creates graph
+Parses the input file and creates the graph based on the leg information passed in.
+Validates with the conduit.txt file. Planets are added to the galaxy in name order. 
+Ships get their ids, and planets their edges, in the order they first appear in the file, 
+and each edge's legs keep their file order until finalize(), so the galaxy is the same for 
+any number of threads. Exits after reporting every line that is not a valid leg. 
+*/
+void Reader::createGraph()
+{
+	int workers = threads > 0 ? threads : default_threads();
+	string_view text = route.view();
+
+	//Chunks start after a line break, so each line is in exactly one of them. 
+	int count = min<size_t>(4 * workers, text.size() / CHUNK_SIZE + 1);
+	vector<Chunk> chunks(count);
+	for (int c = 0; c < count; c++) {
+		size_t begin = text.size() * c / count;
+		while (begin > 0 && begin < text.size() && text[begin - 1] != '\n') {
+			begin++;
+		}
+		chunks[c].begin = c > 0 ? max(begin, chunks[c - 1].begin) : 0;
+		if (c > 0) {
+			chunks[c - 1].end = chunks[c].begin;
+		}
+	}
+	chunks[count - 1].end = text.size();
+	parallel_for(count, workers, [&](int, int c) { parse(chunks[c]); });
+
+	//Join the chunks: number their lines from the start of the file and follow ship runs 
+	//across chunk boundaries. 
+	vector<Record> records;
+	vector<Problem> problems;
+	int lines = 0;
+	string_view last_ship;
+	for (Chunk& chunk : chunks) {
+		for (Problem& problem : chunk.problems) {
+			problem.line += lines;
+			problems.push_back(move(problem));
+		}
+		if (!chunk.records.empty()) {
+			chunk.records[0].continues = !records.empty() && chunk.first_ship == last_ship;
+			last_ship = chunk.last_ship;
+		}
+		for (Record& record : chunk.records) {
+			record.line += lines;
+		}
+		records.insert(records.end(), chunk.records.begin(), chunk.records.end());
+		lines += chunk.lines;
+		chunk.records = vector<Record>();
+	}
+	STAT_ADD(galaxy->stats.bytes_parsed, route.size());
+	STAT_ADD(galaxy->stats.lines_parsed, lines);
+
+	//Validating every leg against the line before it. 
+	int blocks = min<size_t>(4 * workers, records.size() / 4096 + 1);
+	vector<vector<Problem>> invalid(blocks);
+	parallel_for(blocks, workers, [&](int, int b) {
+		for (size_t i = records.size() * b / blocks; i < records.size() * (b + 1) / blocks; i++) {
+			if (records[i].continues) {
+				string reason = validate(records[i - 1], records[i]);
+				if (!reason.empty()) {
+					invalid[b].push_back(Problem{ records[i].line, "is not a valid leg: " + reason });
+				}
+			}
+		}
+	});
+	for (auto& block : invalid) {
+		problems.insert(problems.end(), block.begin(), block.end());
+	}
+	if (!problems.empty()) { //Set of information that caused the error 
+		sort(problems.begin(), problems.end());
+		for (const Problem& problem : problems) {
+			cerr << "Invalid input. Line " << problem.line << " of " << routes_path << " " << problem.message << endl;
+		}
+		cerr << problems.size() << " invalid line(s) in " << routes_path << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	//Ship ids and planets, in file order. 
+	Ship_ID ship = -1;
+	for (Record& record : records) {
+		if (!record.continues) {
+			string_view name, departure, destination;
+			Time departure_time, arrival_time;
+			parse_leg(line_at(record.offset), name, departure, destination, departure_time, arrival_time);
+			auto found = ships.find(name);
+			if (found == ships.end()) {
+				found = ships.emplace(name, galaxy->fleet.add(string(name))).first;
+			}
+			ship = found->second;
+			if (record.departure_name < 0) {
+				record.departure_name = intern(departure);
+			}
+			if (record.destination_name < 0) {
+				record.destination_name = intern(destination);
+			}
+		}
+		record.ship = ship;
+		planet(record.departure_name);
+		planet(record.destination_name);
+	}
+	STAT_ADD(galaxy->stats.legs_loaded, records.size());
+
+	//Bucket the legs by edge: sorted by edge and line, each edge's legs are one run. 
+	vector<pair<uint64_t, int>> legs(records.size());
+	parallel_for(blocks, workers, [&](int, int b) {
+		for (size_t i = records.size() * b / blocks; i < records.size() * (b + 1) / blocks; i++) {
+			legs[i] = make_pair(pair_key(records[i].departure_name, records[i].destination_name), int(i));
+		}
+	});
+	parallel_sort(legs.begin(), legs.end(), less<pair<uint64_t, int>>(), workers);
+	vector<size_t> runs;
+	for (size_t i = 0; i < legs.size(); i++) {
+		if (i == 0 || legs[i].first != legs[i - 1].first) {
+			runs.push_back(i);
+		}
+	}
+	vector<size_t> order(runs.size()); //Runs by the line of their first leg. 
+	for (size_t r = 0; r < runs.size(); r++) {
+		order[r] = r;
+	}
+	sort(order.begin(), order.end(), [&](size_t left, size_t right) { return legs[runs[left]].second < legs[runs[right]].second; });
+	runs.push_back(legs.size());
+	vector<Edge*> edges(order.size());
+	for (size_t r : order) {
+		const Record& first = records[legs[runs[r]].second];
+		edges[r] = galaxy->arena.make<Edge>(planets[first.destination_name]);
+		planets[first.departure_name]->add(edges[r]);
+	}
+	parallel_for(edges.size(), workers, [&](int, int r) {
+		edges[r]->departures.reserve(runs[r + 1] - runs[r]);
+		for (size_t i = runs[r]; i < runs[r + 1]; i++) {
+			const Record& record = records[legs[i].second];
+			Leg leg(record.ship, record.departure_time, record.arrival_time);
+			edges[r]->add(leg);
+		}
+		edges[r]->finalize();
+	});
+
+	vector<Planet*> used;
+	for (Planet* planet : planets) {
+		if (planet) {
+			used.push_back(planet);
+		}
+	}
+	sort(used.begin(), used.end(), [](const Planet* left, const Planet* right) { return left->name < right->name; });
+	for (Planet* planet : used) {
+		galaxy->add(planet);
+	}
+	for (auto const &conduit : travelTimes) { //Keep the travel times between planets of the galaxy for schedule updates. 
+		Planet* start = planets[conduit.first >> 32];
+		Planet* end = planets[conduit.first & 0xffffffff];
+		if (start && end) {
+			galaxy->conduits[Galaxy::conduit_key(start->index, end->index)] = conduit.second;
+		}
+	}
+}
+//**********************************************END OF READER CLASS**********************************************//
+
+
+//**********************************************START OF GALAXY CLASS**********************************************//
+
+/*
+Precondition: None
+Postcondition: None
+Takes the planet a search reported as unreachable (see Search::unreachable()), if any. 
+Will exit program if so (Graph is not well formed). 
+*/
+void Galaxy::checkAllPlanets(Planet* unreachable)
+{
+	if (unreachable) {
+		cerr << "PLANET: " << unreachable->name << ", IS UNREACHABLE!" << endl; 
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+Precondition: None
+Postcondition: None
+Runs Dijkstra's algorithm on each planet utilizing a priority queue. 
+Origins are spread over a pool of worker threads, each with its own Search workspace. 
+The furthest itinerary of every origin is kept and printed afterwards in planet 
+order, so the output is the same for any number of threads. 
+Kept routes that still match the schedule are printed instead. 
+*/
+void Galaxy::search()
+{
+	if (routes && routes->matches(*this)) {
+		PhaseTimer printing(stats.output_seconds);
+		std::vector<Itinerary> schedules(planets.size());
+		std::vector<Planet*> unreachable(planets.size());
+		for (unsigned int i = 0; i < planets.size(); i++) {
+			routes->itinerary(*this, i, routes->furthest(i), schedules[i]);
+			for (unsigned int j = 0; j < planets.size() && !unreachable[i]; j++) {
+				if (routes->arrival_time(i, j) == MAX_TIME) {
+					unreachable[i] = planets[j];
+				}
+			}
+		}
+		print(schedules, unreachable);
+		return;
+	}
+	std::vector<Itinerary> schedules(planets.size());
+	std::vector<Planet*> unreachable(planets.size());
+	search(0, planets.size(), schedules, unreachable);
+	print(schedules, unreachable);
+}
+
+/*
+Precondition: schedules and unreachable hold last - first entries
+Postcondition: None
+See search(). 
+*/
+void Galaxy::search(int first, int last, std::vector<Itinerary>& schedules, std::vector<Planet*>& unreachable)
+{
+	if (batch > 0) {
+		search_batches(first, last, schedules, unreachable);
+		return;
+	}
+	int workers = threads > 0 ? threads : default_threads();
+	if (engine == CONNECTION_SCAN) {
+		std::vector<ScanSearch> workspaces;
+		for (int w = 0; w < workers; w++) {
+			workspaces.emplace_back(*this);
+		}
+		search(workspaces, first, last, schedules, unreachable);
+		return;
+	}
+	if (engine == RAPTOR) {
+		std::vector<RaptorSearch> workspaces;
+		for (int w = 0; w < workers; w++) {
+			workspaces.emplace_back(*this);
+		}
+		search(workspaces, first, last, schedules, unreachable);
+		return;
+	}
+	std::vector<Search> workspaces;
+	workspaces.reserve(workers);
+	for (int w = 0; w < workers; w++) {
+		workspaces.emplace_back(*this, queue);
+	}
+	search(workspaces, first, last, schedules, unreachable);
+}
+
+/*
+Precondition: One workspace per worker thread
+Postcondition: None
+See search(int first, int last, ...). 
+*/
+template<typename Workspace>
+void Galaxy::search(std::vector<Workspace>& workspaces, int first, int last, std::vector<Itinerary>& schedules,
+	std::vector<Planet*>& unreachable)
+{
+	std::shared_ptr<RouteMatrix> kept;
+	if (keep_routes && first == 0 && last == int(planets.size())) {
+		kept = std::make_shared<RouteMatrix>();
+		kept->start(*this);
+	}
+	//RouteWriter allItineraries("AllItineraries.txt", true); //See the commented-out loop below. 
+	PhaseTimer searching(stats.search_seconds);
+	parallel_for(last - first, workspaces.size(), [&](int worker, int k) {
+		Workspace& search = workspaces[worker];
+		int i = first + k;
+		Planet* furthest = search.search(planets[i]); //Furthest planet from the home planet. 
+		search.make_itinerary(furthest, schedules[k]);
+		if (kept) {
+			kept->set_row(*this, i, search);
+		}
+
+		//This for-loop will print out all of the itineraries possible. 
+		//Commented out but was ran once pre-submission just as an additional file to see and compare with. 
+		//May rerun. Intentionally left out in the final submission to ensure better run-time. 
+		/*for (unsigned int j = 0; j < planets.size(); j++) {
+			if (j != i) {
+				search.outputAllRoutes(planets[j], fleet, allItineraries);
+			}
+		}*/
+
+		//search.dumpPredecessors(furthest);
+		unreachable[k] = search.unreachable();
+		search.reset();
+	});
+	for (Workspace& search : workspaces) {
+		stats.search.merge(search.counters);
+		search.counters = SearchCounters();
+	}
+	searching.stop();
+	if (kept) {
+		routes = kept;
+	}
+}
+
+/*
+Precondition: batch is 8, 16 or 32
+Postcondition: None
+See search(int first, int last, ...). Each worker takes batch consecutive origins at a time. 
+*/
+void Galaxy::search_batches(int first, int last, std::vector<Itinerary>& schedules, std::vector<Planet*>& unreachable)
+{
+	int workers = threads > 0 ? threads : default_threads();
+	std::vector<BatchScanSearch> workspaces;
+	for (int w = 0; w < workers; w++) {
+		workspaces.emplace_back(*this, batch);
+	}
+	std::shared_ptr<RouteMatrix> kept;
+	if (keep_routes && first == 0 && last == int(planets.size())) {
+		kept = std::make_shared<RouteMatrix>();
+		kept->start(*this);
+	}
+	PhaseTimer searching(stats.search_seconds);
+	parallel_for((last - first + batch - 1) / batch, workspaces.size(), [&](int worker, int b) {
+		BatchScanSearch& search = workspaces[worker];
+		int origin = first + b * batch;
+		int count = min(batch, last - origin);
+		search.search(origin, count);
+		for (int k = 0; k < count; k++) {
+			search.make_itinerary(k, search.furthest(k), schedules[origin - first + k]);
+			if (kept) {
+				kept->set_row(*this, origin + k, search.lane(k));
+			}
+			unreachable[origin - first + k] = search.unreachable(k);
+		}
+		search.reset();
+	});
+	for (BatchScanSearch& search : workspaces) {
+		stats.search.merge(search.counters);
+		search.counters = SearchCounters();
+	}
+	searching.stop();
+	if (kept) {
+		routes = kept;
+	}
+}
+
+/*
+Precondition: One itinerary and unreachable planet (or nullptr) per origin
+Postcondition: None
+*/
+void Galaxy::print(std::vector<Itinerary>& schedules, const std::vector<Planet*>& unreachable)
+{
+	//Same output as Itinerary::print() for each origin, buffered: sampleRoute.txt is written 
+	//once, with the longest itinerary, and the listing goes to cout in large blocks. 
+	PhaseTimer printing(stats.output_seconds);
+	RouteWriter out(cout);
+	int longest = -1;
+	Planet* missing = nullptr;
+	for (unsigned int i = 0; i < planets.size() && !missing; i++) {
+		if (schedules[i].legs[0].arrival_time > highestTime) {
+			highestTime = schedules[i].legs[0].arrival_time;
+			longest = i;
+		}
+		out.write(schedules[i], fleet);
+		missing = unreachable[i];
+	}
+	if (longest >= 0) {
+		RouteWriter sample("sampleRoute.txt");
+		sample.write(schedules[longest], fleet, false);
+	}
+	out.flush();
+	checkAllPlanets(missing); //Checks if all planets are reachable. 
+}
+
+/*
+Precondition: None
+Postcondition: Returns the arrival time or MAX_TIME
+*/
+Time Galaxy::earliest_arrival(Planet * origin, Planet * destination) const
+{
+	return routes ? routes->arrival_time(origin->index, destination->index) : MAX_TIME;
+}
+
+/*
+Precondition: None
+Postcondition: Returns true and fills the itinerary if the destination can be reached
+*/
+bool Galaxy::route(Planet * origin, Planet * destination, Itinerary & itinerary) const
+{
+	return routes && routes->itinerary(*this, origin->index, destination->index, itinerary);
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns true, filling the itinerary and setting reachable, if a tree answered
+A missing tree is grown with a full search from the start of the departure's bucket. 
+*/
+template<typename Workspace>
+bool Galaxy::tree_query(Workspace & search, Planet * origin, Planet * destination, Time departure,
+	Itinerary & itinerary, bool & reachable) const
+{
+	if (!trees.enabled()) {
+		return false;
+	}
+	std::shared_ptr<const TreeCache::Tree> tree = trees.find(origin->index, departure);
+	if (!tree) {
+		Time start = trees.start(departure);
+		search.search(origin, start);
+		tree = std::make_shared<const TreeCache::Tree>(planets, origin->index, start, search);
+		search.reset();
+		trees.store(tree);
+	}
+	bool answered = tree->route(planets, destination->index, departure, itinerary, reachable);
+	trees.record(answered);
+	return answered;
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns an itinerary or nullptr
+*/
+Itinerary * Galaxy::query(Planet * origin, Planet * destination, Time departure, bool pruned) const
+{
+	Itinerary* itinerary = new Itinerary();
+	if (!query(origin, destination, departure, *itinerary, pruned)) {
+		delete itinerary;
+		return nullptr;
+	}
+	return itinerary;
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns true and fills the itinerary if the destination can be reached
+Answers from the transfer patterns if there are any, else from the cache when it can, then from 
+the tree cache if it is enabled, otherwise runs a single point-to-point query in an idle workspace 
+of the pool, and caches the result. 
+*/
+bool Galaxy::query(Planet * origin, Planet * destination, Time departure, Itinerary & itinerary, bool pruned) const
+{
+	if (patterns) {
+		return patterns->query(*this, origin->index, destination->index, departure, itinerary) != MAX_TIME;
+	}
+	bool reachable;
+	if (cache.find(origin->index, destination->index, departure, itinerary, reachable)) {
+		return reachable;
+	}
+	SearchCounters counters;
+	if (engine == CONNECTION_SCAN) {
+		std::unique_ptr<ScanSearch> search = scan_workspaces.take();
+		if (!search) {
+			search = std::make_unique<ScanSearch>(*this);
+		}
+		if (!tree_query(*search, origin, destination, departure, itinerary, reachable)) {
+			reachable = search->query(origin, destination, departure) != MAX_TIME;
+			if (reachable) {
+				search->make_itinerary(destination, itinerary);
+			}
+			search->reset();
+		}
+		std::swap(counters, search->counters);
+		scan_workspaces.give(std::move(search));
+	}
+	else if (engine == RAPTOR) {
+		std::unique_ptr<RaptorSearch> search = raptor_workspaces.take();
+		if (!search) {
+			search = std::make_unique<RaptorSearch>(*this);
+		}
+		if (!tree_query(*search, origin, destination, departure, itinerary, reachable)) {
+			reachable = search->query(origin, destination, departure) != MAX_TIME;
+			if (reachable) {
+				search->make_itinerary(destination, itinerary);
+			}
+			search->reset();
+		}
+		std::swap(counters, search->counters);
+		raptor_workspaces.give(std::move(search));
+	}
+	else {
+		std::unique_ptr<Search> search = dijkstra_workspaces.take(
+			[&](const Search& idle) { return !pruned || idle.has_bounds(destination); });
+		if (!search || search->queue_kind() != queue) {
+			search = std::make_unique<Search>(*this, queue);
+		}
+		if (!tree_query(*search, origin, destination, departure, itinerary, reachable)) {
+			reachable = search->query(origin, destination, departure, pruned) != MAX_TIME;
+			if (reachable) {
+				search->make_itinerary(destination, itinerary);
+			}
+			search->reset();
+		}
+		std::swap(counters, search->counters);
+		dijkstra_workspaces.give(std::move(search));
+	}
+#if defined(GALAXY_STATS)
+	{
+		lock_guard<mutex> guard(stats_lock);
+		stats.search.merge(counters);
+	}
+#endif
+	cache.store(origin->index, destination->index, departure, reachable ? &itinerary : nullptr);
+	return reachable;
+}
+
+
+/*
+Precondition: None
+Postcondition: Returns a planet or nullptr
+Planets are kept in name order, so this is a binary search. 
+*/
+Planet * Galaxy::find(const std::string & name) const
+{
+	auto planet = std::lower_bound(planets.begin(), planets.end(), name,
+		[](const Planet* planet, const std::string& name) { return planet->name < name; });
+	return planet != planets.end() && (*planet)->name == name ? *planet : nullptr;
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns the number of planets whose arrival times differ
+Searches from every origin with every engine, using the same worker threads as search(). 
+*/
+int Galaxy::cross_check() const
+{
+	int workers = threads > 0 ? threads : default_threads();
+	std::vector<Search> dijkstra;
+	std::vector<ScanSearch> scan;
+	std::vector<RaptorSearch> raptor;
+	dijkstra.reserve(workers);
+	for (int w = 0; w < workers; w++) {
+		dijkstra.emplace_back(*this, queue);
+		scan.emplace_back(*this);
+		raptor.emplace_back(*this);
+	}
+	std::vector<BatchScanSearch> batches;
+	for (int w = 0; w < workers; w++) {
+		batches.emplace_back(*this, 32);
+	}
+	//Besides the full searches, each origin is searched and queried at a few departures through 
+	//the schedule, where the engines board connections a full search skips. 
+	const int DEPARTURES = 4;
+	const int DESTINATIONS = 4;
+	const Connections& c = connections();
+	int V = planets.size();
+	//Per origin: the planets that differ and the departure, -1 for the full search. 
+	std::vector<std::vector<std::pair<int, Time>>> differences(V);
+	int width = batches[0].size();
+	parallel_for((V + width - 1) / width, workers, [&](int worker, int b) {
+		Search& forward = dijkstra[worker];
+		int first = b * width;
+		int count = min(width, V - first);
+		batches[worker].search(first, count);
+		for (int k = 0; k < count; k++) {
+			int i = first + k;
+			forward.search(planets[i]);
+			scan[worker].search(planets[i]);
+			raptor[worker].search(planets[i]);
+			for (Planet* planet : planets) {
+				Time arrival = forward.arrival_time(planet);
+				if (scan[worker].arrival_time(planet) != arrival || raptor[worker].arrival_time(planet) != arrival ||
+					batches[worker].arrival_time(k, planet) != arrival) {
+					differences[i].push_back({ planet->index, -1 });
+				}
+			}
+			forward.reset();
+			scan[worker].reset();
+			raptor[worker].reset();
+
+			for (int s = 0; s < DEPARTURES && c.size() > 0; s++) {
+				Time departure = c.departure_time[size_t(c.size()) * s / DEPARTURES];
+				forward.search(planets[i], departure);
+				scan[worker].search(planets[i], departure);
+				raptor[worker].search(planets[i], departure);
+				for (Planet* planet : planets) {
+					Time arrival = forward.arrival_time(planet);
+					if (scan[worker].arrival_time(planet) != arrival || raptor[worker].arrival_time(planet) != arrival) {
+						differences[i].push_back({ planet->index, departure });
+					}
+				}
+				Time expected[DESTINATIONS];
+				for (int d = 0; d < DESTINATIONS; d++) {
+					expected[d] = forward.arrival_time(planets[(i + 1 + d * V / DESTINATIONS) % V]);
+				}
+				forward.reset();
+				scan[worker].reset();
+				raptor[worker].reset();
+				for (int d = 0; d < DESTINATIONS; d++) {
+					Planet* destination = planets[(i + 1 + d * V / DESTINATIONS) % V];
+					bool same = forward.query(planets[i], destination, departure) == expected[d];
+					forward.reset();
+					same = forward.query(planets[i], destination, departure, true) == expected[d] && same;
+					forward.reset();
+					same = scan[worker].query(planets[i], destination, departure) == expected[d] && same;
+					scan[worker].reset();
+					same = raptor[worker].query(planets[i], destination, departure) == expected[d] && same;
+					raptor[worker].reset();
+					std::pair<int, Time> difference(destination->index, departure);
+					if (!same && std::find(differences[i].begin(), differences[i].end(), difference) == differences[i].end()) {
+						differences[i].push_back(difference);
+					}
+				}
+			}
+		}
+		batches[worker].reset();
+	});
+#if defined(GALAXY_STATS)
+	for (int w = 0; w < workers; w++) {
+		stats.search.merge(dijkstra[w].counters);
+		stats.search.merge(scan[w].counters);
+		stats.search.merge(raptor[w].counters);
+		stats.search.merge(batches[w].counters);
+	}
+#endif
+
+	int count = 0;
+	for (int i = 0; i < V; i++) {
+		for (const std::pair<int, Time>& difference : differences[i]) {
+			cerr << "START: " << planets[i]->name << ", END: " << planets[difference.first]->name;
+			if (difference.second >= 0) {
+				cerr << ", DEPARTURE: " << difference.second;
+			}
+			cerr << " DIFFERS BETWEEN ENGINES" << endl;
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns the journeys in ascending order of departure
+*/
+vector<ProfileSearch::Entry> Galaxy::profile(Planet * origin, Planet * destination, Time from, Time until) const
+{
+	ProfileSearch search(*this);
+	vector<ProfileSearch::Entry> result = search.profile(origin, destination, from, until);
+#if defined(GALAXY_STATS)
+	lock_guard<mutex> guard(stats_lock);
+	stats.search.merge(search.counters);
+#endif
+	return result;
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns the connection array of the current schedule
+*/
+const Connections & Galaxy::connections() const
+{
+	lock_guard<mutex> guard(connections_lock);
+	if (!connections_built) {
+		connection_list = Connections(*this);
+		connections_built = true;
+	}
+	return connection_list;
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns the trips of the current schedule
+*/
+const Trips & Galaxy::trips() const
+{
+	const Connections& list = connections();
+	lock_guard<mutex> guard(trips_lock);
+	if (!trips_built) {
+		trip_list = Trips(list, planets.size());
+		trips_built = true;
+	}
+	return trip_list;
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns the journeys, fewest transfers first
+*/
+vector<RaptorSearch::Journey> Galaxy::journeys(Planet * origin, Planet * destination, Time departure, int max_transfers) const
+{
+	RaptorSearch search(*this);
+	vector<RaptorSearch::Journey> result = search.journeys(origin, destination, departure, max_transfers);
+#if defined(GALAXY_STATS)
+	lock_guard<mutex> guard(stats_lock);
+	stats.search.merge(search.counters);
+#endif
+	return result;
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the leg was added
+Checks the planets, the conduit's travel time and the ship's neighbouring legs before adding the leg. 
+*/
+bool Galaxy::insert_leg(const string & ship, const string & from, const string & to, Time departure, Time arrival)
+{
+	thaw();
+	Planet* origin = find(from);
+	Planet* destination = find(to);
+	if (!origin || !destination) {
+		cerr << "Unknown planet: " << (origin ? to : from) << endl;
+		return false;
+	}
+	auto hours = conduits.find(conduit_key(origin->index, destination->index));
+	if (hours == conduits.end()) {
+		cerr << "No conduit between " << from << " and " << to << endl;
+		return false;
+	}
+	if (departure < 0 || departure + hours->second != arrival) {
+		cerr << "Invalid leg: " << from << " to " << to << " takes " << hours->second << " hours" << endl;
+		return false;
+	}
+	Ship_ID id;
+	auto known = ships.find(ship);
+	if (known == ships.end()) {
+		id = ships[ship] = fleet.add(ship);
+		flights.emplace_back();
+	}
+	else {
+		id = known->second;
+	}
+	Flight flight = { origin->index, destination->index, departure, arrival };
+	if (!fits(id, flight, -1)) {
+		return false;
+	}
+	add_flight(id, flight);
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the leg was removed
+*/
+bool Galaxy::cancel_leg(const string & ship, const string & from, Time departure)
+{
+	thaw();
+	Ship_ID id;
+	Planet* origin = find(from);
+	if (!origin) {
+		cerr << "Unknown planet: " << from << endl;
+		return false;
+	}
+	if (!find_ship(ship, id)) {
+		return false;
+	}
+	int position = find_flight(id, origin->index, departure);
+	if (position < 0) {
+		cerr << ship << " has no leg leaving " << from << " at " << departure << endl;
+		return false;
+	}
+	remove_flight(id, position);
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the leg was moved
+The moved leg is checked against the ship's other legs; the leg itself is ignored. 
+*/
+bool Galaxy::shift_leg(const string & ship, const string & from, Time departure, Time delay)
+{
+	thaw();
+	Ship_ID id;
+	Planet* origin = find(from);
+	if (!origin) {
+		cerr << "Unknown planet: " << from << endl;
+		return false;
+	}
+	if (!find_ship(ship, id)) {
+		return false;
+	}
+	int position = find_flight(id, origin->index, departure);
+	if (position < 0) {
+		cerr << ship << " has no leg leaving " << from << " at " << departure << endl;
+		return false;
+	}
+	Flight flight = flights[id][position];
+	flight.departure += delay;
+	flight.arrival += delay;
+	if (flight.departure < 0 || !fits(id, flight, position)) {
+		return false;
+	}
+	remove_flight(id, position);
+	add_flight(id, flight);
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: Returns true and sets ship if the name is known
+*/
+bool Galaxy::find_ship(const string & name, Ship_ID & ship)
+{
+	auto known = ships.find(name);
+	if (known == ships.end()) {
+		cerr << "Unknown ship: " << name << endl;
+		return false;
+	}
+	ship = known->second;
+	return true;
+}
+
+/*
+Precondition: thaw() has been called
+Postcondition: Returns a position in flights[ship] or -1
+*/
+int Galaxy::find_flight(Ship_ID ship, int origin, Time departure)
+{
+	const vector<Flight>& route = flights[ship];
+	for (unsigned int i = 0; i < route.size(); i++) {
+		if (route[i].origin == origin && route[i].departure == departure) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+Precondition: thaw() has been called
+Postcondition: Returns true if the flight fits the ship's route
+The ship's previous leg must end at the flight's origin at least TURNAROUND_TIME before it 
+departs, and its next leg must start from the flight's destination at least TURNAROUND_TIME 
+after it arrives. 
+*/
+bool Galaxy::fits(Ship_ID ship, const Flight & flight, int skip)
+{
+	const vector<Flight>& route = flights[ship];
+	const Flight* previous = nullptr;
+	const Flight* next = nullptr;
+	for (unsigned int i = 0; i < route.size(); i++) {
+		if (int(i) == skip) {
+			continue;
+		}
+		if (route[i].departure == flight.departure) {
+			cerr << fleet.name(ship) << " already has a leg departing at " << flight.departure << endl;
+			return false;
+		}
+		if (route[i].departure < flight.departure) {
+			previous = &route[i];
+		}
+		else if (!next) {
+			next = &route[i];
+		}
+	}
+	if (previous && (previous->destination != flight.origin || previous->arrival + TURNAROUND_TIME > flight.departure)) {
+		cerr << fleet.name(ship) << " cannot leave " << planets[flight.origin]->name << " at " << flight.departure
+			<< " after arriving at " << planets[previous->destination]->name << " at " << previous->arrival << endl;
+		return false;
+	}
+	if (next && (next->origin != flight.destination || flight.arrival + TURNAROUND_TIME > next->departure)) {
+		cerr << fleet.name(ship) << " cannot make its " << next->departure << " departure from "
+			<< planets[next->origin]->name << " after arriving at " << planets[flight.destination]->name
+			<< " at " << flight.arrival << endl;
+		return false;
+	}
+	return true;
+}
+
+/*
+Precondition: thaw() has been called and the flight fits
+Postcondition: None
+A leg on a conduit no ship has flown before adds an edge, which changes the structure of the 
+graph and so rebuilds the compact form. Otherwise the updated Edge replaces the edge's slice 
+of the compact form until so many edges have changed that rebuilding is cheaper. 
+*/
+void Galaxy::add_flight(Ship_ID ship, const Flight & flight)
+{
+	vector<Flight>& route = flights[ship];
+	route.insert(upper_bound(route.begin(), route.end(), flight,
+		[](const Flight& left, const Flight& right) { return left.departure < right.departure; }), flight);
+
+	Leg leg(ship, flight.departure, flight.arrival);
+	Planet* origin = planets[flight.origin];
+	int e = compact.find_edge(flight.origin, flight.destination);
+	if (e < 0) {
+		Edge* edge = arena.make<Edge>(planets[flight.destination]);
+		edge->add(leg);
+		edge->finalize();
+		origin->add(edge);
+		freeze();
+		changed_edges = 0;
+	}
+	else {
+		Edge* edge = nullptr;
+		for (Edge* candidate : origin->edges) {
+			if (candidate->destination->index == flight.destination) {
+				edge = candidate;
+			}
+		}
+		edge->insert(leg);
+		if (compact.changed.empty()) {
+			compact.changed.assign(compact.edge_count(), nullptr);
+		}
+		if (!compact.changed[e]) {
+			compact.changed[e] = edge;
+			changed_edges++;
+		}
+		if (changed_edges * 4 > compact.edge_count()) {
+			freeze();
+			changed_edges = 0;
+		}
+	}
+	cache.leg_added(leg);
+	trees.leg_added(leg);
+	routes.reset();
+	patterns.reset();
+	connections_built = false;
+	trips_built = false;
+	dijkstra_workspaces.clear();
+	scan_workspaces.clear();
+	raptor_workspaces.clear();
+	generation++;
+}
+
+/*
+Precondition: thaw() has been called
+Postcondition: None
+See add_flight(). 
+*/
+void Galaxy::remove_flight(Ship_ID ship, int position)
+{
+	Flight flight = flights[ship][position];
+	flights[ship].erase(flights[ship].begin() + position);
+
+	Planet* origin = planets[flight.origin];
+	int e = compact.find_edge(flight.origin, flight.destination);
+	for (Edge* edge : origin->edges) {
+		if (edge->destination->index == flight.destination) {
+			edge->remove(ship, flight.departure);
+			if (compact.changed.empty()) {
+				compact.changed.assign(compact.edge_count(), nullptr);
+			}
+			if (!compact.changed[e]) {
+				compact.changed[e] = edge;
+				changed_edges++;
+			}
+		}
+	}
+	if (changed_edges * 4 > compact.edge_count()) {
+		freeze();
+		changed_edges = 0;
+	}
+	cache.leg_removed(flight.origin, flight.destination, Leg(ship, flight.departure, flight.arrival));
+	trees.leg_removed(flight.origin, flight.destination, Leg(ship, flight.departure, flight.arrival));
+	routes.reset();
+	patterns.reset();
+	connections_built = false;
+	trips_built = false;
+	dijkstra_workspaces.clear();
+	scan_workspaces.clear();
+	raptor_workspaces.clear();
+	generation++;
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Every planet has its Edge objects and flights holds every ship's route
+A galaxy loaded from a snapshot only has the compact form; its Edge objects are rebuilt from 
+the timetable pool and the compact form is rebuilt to own its arrays. 
+*/
+void Galaxy::thaw()
+{
+	if (thawed) {
+		return;
+	}
+	bool hasEdges = false;
+	for (Planet* planet : planets) {
+		hasEdges = hasEdges || !planet->edges.empty();
+	}
+	if (!hasEdges && compact.edge_count() > 0) {
+		for (int p = 0; p < compact.planet_count(); p++) {
+			for (int e = compact.edge_begin[p]; e < compact.edge_begin[p + 1]; e++) {
+				Edge* edge = arena.make<Edge>(planets[compact.edge_destination[e]]);
+				for (int l = compact.leg_begin[e]; l < compact.leg_begin[e + 1]; l++) {
+					Leg leg = compact.timetable[l];
+					edge->add(leg);
+				}
+				edge->finalize();
+				planets[p]->add(edge);
+			}
+		}
+		freeze();
+	}
+
+	flights.assign(fleet.size(), vector<Flight>());
+	for (int id = 0; id < fleet.size(); id++) {
+		ships[fleet.name(id)] = id;
+	}
+	for (int e = 0; e < compact.edge_count(); e++) {
+		for (int l = compact.leg_begin[e]; l < compact.leg_begin[e + 1]; l++) {
+			Flight flight = { compact.edge_source[e], compact.edge_destination[e],
+				compact.timetable.departure_time[l], compact.timetable.arrival_time[l] };
+			flights[compact.timetable.id[l]].push_back(flight);
+		}
+	}
+	for (auto& route : flights) {
+		stable_sort(route.begin(), route.end(),
+			[](const Flight& left, const Flight& right) { return left.departure < right.departure; });
+	}
+	thawed = true;
+}
+
+/*
+Precondition: None
+Postcondition: None
+Dumps out the planets.
+*/
+void Galaxy::dump()
+{
+	for (unsigned int i = 0; i < planets.size(); i++) {
+		planets[i]->dump(this);
+	}
+}
+//**********************************************END OF GALAXY CLASS**********************************************//
+
+//**********************************************START OF QUERYCACHE CLASS**********************************************//
+
+/*
+Precondition: None
+Postcondition: Returns true if the query is cached
+*/
+bool QueryCache::find(int origin, int destination, Time departure, Itinerary & itinerary, bool & reachable)
+{
+	lock_guard<mutex> guard(lock);
+	auto entry = entries.find(Key{ origin, destination, departure });
+	if (entry == entries.end()) {
+		return false;
+	}
+	reachable = entry->second.reachable;
+	if (reachable) {
+		itinerary = entry->second.itinerary;
+	}
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: None
+Starts over once the cache holds capacity results. The entries it drops then are kept, and a 
+new result is copied into one of them, whose itinerary's buffers are usually large enough. 
+*/
+void QueryCache::store(int origin, int destination, Time departure, const Itinerary * itinerary)
+{
+	lock_guard<mutex> guard(lock);
+	Key key{ origin, destination, departure };
+	auto found = entries.find(key);
+	if (found == entries.end()) {
+		if (entries.size() >= capacity) {
+			spare.reserve(capacity);
+			while (!entries.empty()) {
+				spare.push_back(entries.extract(entries.begin()));
+			}
+		}
+		if (spare.empty()) {
+			found = entries.emplace(key, Entry()).first;
+		}
+		else {
+			Entries::node_type node = std::move(spare.back());
+			spare.pop_back();
+			node.key() = key;
+			found = entries.insert(std::move(node)).position;
+		}
+	}
+	Entry& entry = found->second;
+	entry.reachable = itinerary != nullptr;
+	if (itinerary) {
+		entry.itinerary = *itinerary;
+	}
+}
+
+/*
+Precondition: None
+Postcondition: None
+A new leg can only improve a result that departs no later than the leg and arrives after it. 
+*/
+void QueryCache::leg_added(const Leg & leg)
+{
+	lock_guard<mutex> guard(lock);
+	for (auto entry = entries.begin(); entry != entries.end();) {
+		bool improvable = entry->first.departure <= leg.departure_time &&
+			(!entry->second.reachable || entry->second.itinerary.legs[0].arrival_time > leg.arrival_time);
+		entry = improvable ? entries.erase(entry) : next(entry);
+	}
+}
+
+/*
+Precondition: None
+Postcondition: None
+Removing a leg can only spoil the results whose itinerary flies it. In an itinerary, 
+legs[i] flies from destinations[i + 1] to destinations[i]. 
+*/
+void QueryCache::leg_removed(int from, int to, const Leg & leg)
+{
+	lock_guard<mutex> guard(lock);
+	for (auto entry = entries.begin(); entry != entries.end();) {
+		bool uses = false;
+		const Itinerary& itinerary = entry->second.itinerary;
+		for (unsigned int i = 0; entry->second.reachable && i + 1 < itinerary.legs.size(); i++) {
+			uses = uses || (itinerary.destinations[i + 1]->index == from && itinerary.destinations[i]->index == to &&
+				itinerary.legs[i].id == leg.id && itinerary.legs[i].departure_time == leg.departure_time);
+		}
+		entry = uses ? entries.erase(entry) : next(entry);
+	}
+}
+
+/*
+Precondition: None
+Postcondition: The cache is empty
+*/
+void QueryCache::clear()
+{
+	lock_guard<mutex> guard(lock);
+	entries.clear();
+}
+//**********************************************END OF QUERYCACHE CLASS**********************************************//
+
+//**********************************************START OF TREECACHE CLASS**********************************************//
+
+/*
+Precondition: None
+Postcondition: Returns true if the tree answers for the departure
+The itinerary is the tree's if it leaves the origin at or after the departure: it is then the 
+earliest arrival for the later start too. The traveller is at the origin from the departure, 
+as after Search::query(). 
+*/
+bool TreeCache::Tree::route(const vector<Planet*>& planets, int destination, Time departure,
+	Itinerary & itinerary, bool & reachable) const
+{
+	itinerary.origin = planets[origin];
+	itinerary.destinations.clear();
+	itinerary.legs.clear();
+	reachable = legs[destination].arrival_time != MAX_TIME;
+	if (!reachable) {
+		return true;
+	}
+	for (int stop = destination; stop != origin; stop = predecessor[stop]) {
+		itinerary.destinations.push_back(planets[stop]);
+		itinerary.legs.push_back(legs[stop]);
+	}
+	if (!itinerary.legs.empty() && itinerary.legs.back().departure_time < departure) {
+		return false;
+	}
+	itinerary.destinations.push_back(planets[origin]);
+	itinerary.legs.push_back(Leg(-1, departure, departure));
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: The cache is empty
+*/
+void TreeCache::configure(size_t capacity, Time bucket)
+{
+	clear();
+	lock_guard<mutex> guard(lock);
+	this->capacity = capacity;
+	this->bucket = bucket > 0 ? bucket : 1;
+}
+
+/*
+Precondition: None
+Postcondition: Returns a tree or nullptr
+Marks the tree found as the most recently used. 
+*/
+shared_ptr<const TreeCache::Tree> TreeCache::find(int origin, Time departure)
+{
+	lock_guard<mutex> guard(lock);
+	auto entry = entries.find(Key{ origin, start(departure) });
+	if (entry == entries.end()) {
+		return nullptr;
+	}
+	order.splice(order.begin(), order, entry->second);
+	return *entry->second;
+}
+
+/*
+Precondition: None
+Postcondition: None
+A tree for the same origin and bucket (grown by another thread meanwhile) is replaced. 
+*/
+void TreeCache::store(shared_ptr<const Tree> tree)
+{
+	lock_guard<mutex> guard(lock);
+	if (capacity == 0) {
+		return;
+	}
+	auto entry = entries.find(Key{ tree->origin, tree->departure });
+	if (entry != entries.end()) {
+		erase(entry->second);
+	}
+	while (order.size() >= capacity) {
+		erase(prev(order.end()));
+		evictions++;
+	}
+	bytes += tree->bytes();
+	order.push_front(move(tree));
+	entries[Key{ order.front()->origin, order.front()->departure }] = order.begin();
+}
+
+/*
+Precondition: None
+Postcondition: None
+*/
+void TreeCache::record(bool hit)
+{
+	lock_guard<mutex> guard(lock);
+	(hit ? hits : misses)++;
+}
+
+/*
+Precondition: None
+Postcondition: None
+A new leg can only improve the trees of buckets starting no later than it departs. 
+*/
+void TreeCache::leg_added(const Leg & leg)
+{
+	lock_guard<mutex> guard(lock);
+	for (auto tree = order.begin(); tree != order.end();) {
+		auto next_tree = next(tree);
+		if ((*tree)->departure <= leg.departure_time) {
+			erase(tree);
+		}
+		tree = next_tree;
+	}
+}
+
+/*
+Precondition: None
+Postcondition: None
+Removing a leg can only spoil the trees whose last leg to its arrival planet it is. 
+*/
+void TreeCache::leg_removed(int from, int to, const Leg & leg)
+{
+	lock_guard<mutex> guard(lock);
+	for (auto tree = order.begin(); tree != order.end();) {
+		auto next_tree = next(tree);
+		const Leg& last = (*tree)->legs[to];
+		if ((*tree)->predecessor[to] == from && last.id == leg.id && last.departure_time == leg.departure_time) {
+			erase(tree);
+		}
+		tree = next_tree;
+	}
+}
+
+/*
+Precondition: None
+Postcondition: The cache is empty
+*/
+void TreeCache::clear()
+{
+	lock_guard<mutex> guard(lock);
+	order.clear();
+	entries.clear();
+	bytes = 0;
+}
+
+/*
+Precondition: None
+Postcondition: Returns the usage figures
+*/
+TreeCache::Usage TreeCache::usage()
+{
+	lock_guard<mutex> guard(lock);
+	return Usage{ hits, misses, evictions, order.size(), bytes };
+}
+
+/*
+Precondition: The caller holds the lock
+Postcondition: None
+*/
+void TreeCache::erase(Order::iterator tree)
+{
+	bytes -= (*tree)->bytes();
+	entries.erase(Key{ (*tree)->origin, (*tree)->departure });
+	order.erase(tree);
+}
+//**********************************************END OF TREECACHE CLASS**********************************************//
+
+//**********************************************START OF CONNECTIONS CLASS**********************************************//
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Holds every leg of the galaxy in departure order
+Legs are gathered edge by edge and then stably sorted, so legs departing at the same time keep 
+their timetable order. 
+*/
+Connections::Connections(const Galaxy & galaxy)
+{
+	const CompactGalaxy& compact = galaxy.compact;
+	vector<int> edge;
+	vector<Leg> legs;
+	for (int e = 0; e < compact.edge_count(); e++) {
+		if (!compact.changed.empty() && compact.changed[e]) {
+			for (const Leg& leg : compact.changed[e]->departures) {
+				edge.push_back(e);
+				legs.push_back(leg);
+			}
+			continue;
+		}
+		for (int l = compact.leg_begin[e]; l < compact.leg_begin[e + 1]; l++) {
+			edge.push_back(e);
+			legs.push_back(compact.timetable[l]);
+		}
+	}
+	vector<int> order(legs.size());
+	for (unsigned int i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	stable_sort(order.begin(), order.end(),
+		[&](int left, int right) { return legs[left].departure_time < legs[right].departure_time; });
+
+	source.reserve(order.size());
+	destination.reserve(order.size());
+	departure_time.reserve(order.size());
+	arrival_time.reserve(order.size());
+	id.reserve(order.size());
+	this->edge.reserve(order.size());
+	for (int i : order) {
+		source.push_back(compact.edge_source[edge[i]]);
+		destination.push_back(compact.edge_destination[edge[i]]);
+		departure_time.push_back(legs[i].departure_time);
+		arrival_time.push_back(legs[i].arrival_time);
+		id.push_back(legs[i].id);
+		this->edge.push_back(edge[i]);
+	}
+}
+//**********************************************END OF CONNECTIONS CLASS**********************************************//
+
+//**********************************************START OF TRIPS CLASS**********************************************//
+
+/*
+Precondition: None
+Postcondition: Holds every connection, grouped into trips
+Each ship's connections are taken in departure order; a trip ends where the ship's next 
+connection does not leave from the planet the last one arrived at, TURNAROUND_TIME after it 
+arrived. The Reader only checks a ship's legs against the line above, so a route split over the 
+file can contradict itself. 
+*/
+Trips::Trips(const Connections & connections, int planets)
+{
+	int ships = 0;
+	for (int i = 0; i < connections.size(); i++) {
+		ships = std::max(ships, connections.id[i] + 1);
+	}
+	//Bucket the connections by ship, keeping departure order. 
+	vector<int> start(ships + 1, 0);
+	for (int i = 0; i < connections.size(); i++) {
+		start[connections.id[i] + 1]++;
+	}
+	for (int ship = 0; ship < ships; ship++) {
+		start[ship + 1] += start[ship];
+	}
+	vector<int> order(connections.size());
+	for (int i = 0; i < connections.size(); i++) {
+		order[start[connections.id[i]]++] = i;
+	}
+
+	source.reserve(order.size());
+	destination.reserve(order.size());
+	departure_time.reserve(order.size());
+	arrival_time.reserve(order.size());
+	id.reserve(order.size());
+	for (int i : order) {
+		if (id.empty() || id.back() != connections.id[i] || destination.back() != connections.source[i] ||
+			arrival_time.back() + TURNAROUND_TIME > connections.departure_time[i]) {
+			begin.push_back(id.size());
+		}
+		source.push_back(connections.source[i]);
+		destination.push_back(connections.destination[i]);
+		departure_time.push_back(connections.departure_time[i]);
+		arrival_time.push_back(connections.arrival_time[i]);
+		id.push_back(connections.id[i]);
+	}
+	begin.push_back(id.size());
+	last_departure = connections.size() > 0 ? connections.departure_time[connections.size() - 1] : 0;
+
+	//Bucket the legs by departure planet, then order each planet's legs by departure time. 
+	departure_begin.assign(planets + 1, 0);
+	for (int planet : source) {
+		departure_begin[planet + 1]++;
+	}
+	for (int planet = 0; planet < planets; planet++) {
+		departure_begin[planet + 1] += departure_begin[planet];
+	}
+	vector<int> position(departure_begin.begin(), departure_begin.end() - 1);
+	departures.resize(source.size());
+	trip.resize(source.size());
+	for (int t = 0; t < size(); t++) {
+		for (int leg = begin[t]; leg < begin[t + 1]; leg++) {
+			trip[leg] = t;
+			departures[position[source[leg]]++] = leg;
+		}
+	}
+	for (int planet = 0; planet < planets; planet++) {
+		stable_sort(departures.begin() + departure_begin[planet], departures.begin() + departure_begin[planet + 1],
+			[&](int left, int right) { return departure_time[left] < departure_time[right]; });
+	}
+}
+//**********************************************END OF TRIPS CLASS**********************************************//
+
+//**********************************************START OF PROFILESEARCH CLASS**********************************************//
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: None
+*/
+ProfileSearch::ProfileSearch(const Galaxy & galaxy) : galaxy(galaxy), latest(galaxy)
+{
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns the non-dominated journeys in ascending order of departure
+Scans the connections from the latest useful departure down to from: no journey in the window 
+needs to leave anywhere after the earliest arrival for a departure at until. A connection is worth taking if 
+it reaches the destination directly, or if the profile of the planet it arrives at (built from 
+later connections) continues TRANSFER_TIME after its arrival. Its departure planet gains the 
+journey if that beats every journey from there leaving no earlier. 
+*/
+vector<ProfileSearch::Entry> ProfileSearch::profile(Planet * origin, Planet * destination, Time from, Time until)
+{
+	const Connections& connections = galaxy.connections();
+	int target = destination->index;
+	profiles.assign(galaxy.planets.size(), vector<Entry>());
+	Time cutoff = latest.query(origin, destination, until);
+	latest.reset();
+	counters.merge(latest.counters);
+	latest.counters = SearchCounters();
+	int last = cutoff == MAX_TIME ? connections.size() : connections.first(cutoff + 1);
+	for (int c = last - 1; c >= 0 && connections.departure_time[c] >= from; c--) {
+		STAT_ADD(counters.connections_scanned, 1);
+		int source = connections.source[c];
+		if (source == target) {
+			continue;
+		}
+		Time arrive = connections.destination[c] == target ? connections.arrival_time[c] :
+			arrival(connections.destination[c], connections.arrival_time[c] + TRANSFER_TIME);
+		vector<Entry>& journeys = profiles[source];
+		if (arrive == MAX_TIME || (!journeys.empty() && journeys.back().arrival <= arrive)) {
+			continue;
+		}
+		if (!journeys.empty() && journeys.back().departure == connections.departure_time[c]) {
+			journeys.back().arrival = arrive; //Same departure, earlier arrival. 
+		}
+		else {
+			journeys.push_back(Entry{ connections.departure_time[c], arrive });
+		}
+	}
+
+	vector<Entry> result;
+	const vector<Entry>& journeys = profiles[origin->index];
+	for (auto entry = journeys.rbegin(); entry != journeys.rend(); entry++) {
+		if (entry->departure <= until && origin != destination) {
+			result.push_back(*entry);
+		}
+	}
+	return result;
+}
+
+/*
+Precondition: Every connection departing at or after t has been scanned
+Postcondition: Returns an arrival time or MAX_TIME
+The first journey leaving at or after t arrives earliest, since journeys leaving later arrive later. 
+*/
+Time ProfileSearch::arrival(int planet, Time t) const
+{
+	const vector<Entry>& journeys = profiles[planet];
+	auto entry = upper_bound(journeys.begin(), journeys.end(), t,
+		[](Time time, const Entry& journey) { return journey.departure < time; });
+	return entry == journeys.begin() ? MAX_TIME : (entry - 1)->arrival;
+}
+//**********************************************END OF PROFILESEARCH CLASS**********************************************//
+
+//**********************************************START OF SCANSEARCH CLASS**********************************************//
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: None
+*/
+ScanSearch::ScanSearch(const Galaxy & galaxy) : galaxy(galaxy), connections(nullptr), origin(nullptr),
+	arrival(galaxy.planets.size(), MAX_TIME), arrived_by(galaxy.planets.size(), -1), aboard(galaxy.fleet.size(), -1)
+{
+}
+
+/*
+Precondition: The workspace has been reset
+Postcondition: Returns the furthest planet by arrival time
+The traveller is at the origin at hour 0 and boards from TRANSFER_TIME, as in Search::search(). 
+Of the planets reached last, the one with the highest index is returned, which is the planet 
+Search settles last. 
+*/
+Planet * ScanSearch::search(Planet * origin)
+{
+	this->origin = origin;
+	origin_leg = Leg(-1, 0, 0); //Home planet
+	STAT_ADD(counters.searches, 1);
+	scan(TRANSFER_TIME, -1);
+	return furthest();
+}
+
+/*
+Precondition: None
+Postcondition: Returns the furthest planet by arrival time
+See search(Planet * origin). 
+*/
+Planet * ScanSearch::search(Planet * origin, Time departure)
+{
+	reset();
+	this->origin = origin;
+	origin_leg = Leg(-1, departure, departure);
+	STAT_ADD(counters.searches, 1);
+	scan(departure, -1);
+	return furthest();
+}
+
+/*
+Precondition: A scan has run
+Postcondition: Returns the furthest planet by arrival time
+*/
+Planet * ScanSearch::furthest() const
+{
+	int latest = origin->index;
+	for (int planet : touched_planets) {
+		if (arrival[planet] > arrival[latest] || (arrival[planet] == arrival[latest] && planet > latest)) {
+			latest = planet;
+		}
+	}
+	return galaxy.planets[latest];
+}
+
+/*
+Precondition: None
+Postcondition: Returns the arrival time at the destination or MAX_TIME
+*/
+Time ScanSearch::query(Planet * origin, Planet * destination, Time departure)
+{
+	reset();
+	this->origin = origin;
+	origin_leg = Leg(-1, departure, departure);
+	STAT_ADD(counters.searches, 1);
+	scan(departure, destination->index);
+	return arrival[destination->index];
+}
+
+/*
+Precondition: None
+Postcondition: None
+Takes the connections departing from ready onwards. A connection can be taken by staying 
+aboard its ship, if the ship's last connection taken arrived where it departs TURNAROUND_TIME 
+before it (the Reader only checks a ship's legs against the line above, so a route split over 
+the file can contradict itself), or by boarding 
+at its departure planet; the earliest arrival at a planet is only improved, never replaced by 
+a later one. With a target the scan stops at the first connection departing no earlier than 
+the target's arrival, since no later connection can arrive before it; without one, at the 
+first connection departing after every planet has been reached. 
+*/
+void ScanSearch::scan(Time ready, int target)
+{
+	connections = &galaxy.connections();
+	const Connections& c = *connections;
+	stayed_from.resize(c.size());
+	arrival[origin->index] = origin_leg.arrival_time;
+	touched_planets.push_back(origin->index);
+
+	Time last = MAX_TIME; //No connection departing after this can improve an arrival. 
+	int planets = arrival.size();
+	for (int i = c.first(ready); i < c.size(); i++) {
+		if (c.departure_time[i] >= (target >= 0 ? arrival[target] : last)) {
+			break;
+		}
+		STAT_ADD(counters.connections_scanned, 1);
+		int source = c.source[i];
+		int ship = c.id[i];
+		int previous = aboard[ship];
+		bool stay = previous >= 0 && c.destination[previous] == source &&
+			c.arrival_time[previous] + TURNAROUND_TIME <= c.departure_time[i];
+		bool board = source == origin->index || (arrival[source] != MAX_TIME &&
+			arrival[source] + TRANSFER_TIME <= c.departure_time[i]);
+		if (!stay && !board) {
+			aboard[ship] = -1;
+			continue;
+		}
+		if (previous < 0) {
+			touched_ships.push_back(ship);
+		}
+		aboard[ship] = i;
+		stayed_from[i] = stay ? previous : -1;
+		int destination = c.destination[i];
+		if (c.arrival_time[i] < arrival[destination]) {
+			bool reached = arrival[destination] == MAX_TIME;
+			if (reached) {
+				touched_planets.push_back(destination);
+			}
+			arrival[destination] = c.arrival_time[i];
+			arrived_by[destination] = i;
+			STAT_ADD(counters.relaxations, 1);
+			if (reached && int(touched_planets.size()) == planets) {
+				last = *max_element(arrival.begin(), arrival.end());
+			}
+		}
+	}
+}
+
+/*
+Precondition: None
+Postcondition: None
+Clears the planets and ships the last scan reached. 
+*/
+void ScanSearch::reset()
+{
+	for (int planet : touched_planets) {
+		arrival[planet] = MAX_TIME;
+		arrived_by[planet] = -1;
+	}
+	for (int ship : touched_ships) {
+		aboard[ship] = -1;
+	}
+	touched_planets.clear();
+	touched_ships.clear();
+	origin = nullptr;
+}
+
+/*
+Precondition: None
+Postcondition: Returns the itinerary in the same form as Search::make_itinerary()
+Walks back from the connection arriving at the destination to the origin. Each step goes to 
+the connection arriving first at the departure planet if the traveller could have changed 
+there, and otherwise to the connection the traveller stayed aboard from, so itineraries wait 
+on a planet rather than ride a ship around a loop. 
+*/
+Itinerary * ScanSearch::make_itinerary(Planet * destination)
+{
+	Itinerary* schedule = new Itinerary();
+	make_itinerary(destination, *schedule);
+	return schedule;
+}
+
+/*
+Precondition: None
+Postcondition: The itinerary holds the route to the destination
+See make_itinerary(Planet * destination). 
+*/
+void ScanSearch::make_itinerary(Planet * destination, Itinerary & schedule)
+{
+	const Connections& c = *connections;
+	schedule.origin = origin;
+	schedule.destinations.clear();
+	schedule.legs.clear();
+	int connection = arrived_by[destination->index];
+	while (connection >= 0) {
+		schedule.destinations.push_back(galaxy.planets[c.destination[connection]]);
+		schedule.legs.push_back(Leg(c.id[connection], c.departure_time[connection], c.arrival_time[connection]));
+		int source = c.source[connection];
+		if (source == origin->index) {
+			break;
+		}
+		bool board = arrival[source] + TRANSFER_TIME <= c.departure_time[connection];
+		connection = board ? arrived_by[source] : stayed_from[connection];
+	}
+	schedule.destinations.push_back(origin);
+	schedule.legs.push_back(origin_leg);
+}
+
+/*
+Precondition: None
+Postcondition: Returns a planet or nullptr
+*/
+Planet * ScanSearch::unreachable() const
+{
+	for (unsigned int i = 0; i < arrival.size(); i++) {
+		if (arrival[i] == MAX_TIME) {
+			return galaxy.planets[i];
+		}
+	}
+	return nullptr;
+}
+
+/*
+Precondition: None
+Postcondition: None
+See Search::outputAllRoutes(). 
+*/
+void ScanSearch::outputAllRoutes(Planet * destination, Fleet & fleet, RouteWriter & out)
+{
+	make_itinerary(destination, route);
+	out.write(route, fleet);
+}
+
+/*
+Precondition: None
+Postcondition: Returns the leg, the origin's leg for the origin or Leg() if not reached
+*/
+Leg ScanSearch::best_leg(const Planet * planet) const
+{
+	int connection = arrived_by[planet->index];
+	if (connection < 0) {
+		return planet == origin ? origin_leg : Leg();
+	}
+	const Connections& c = *connections;
+	return Leg(c.id[connection], c.departure_time[connection], c.arrival_time[connection]);
+}
+
+/*
+Precondition: None
+Postcondition: Returns a planet or nullptr
+*/
+Planet * ScanSearch::getPred(const Planet * planet) const
+{
+	int connection = arrived_by[planet->index];
+	return connection < 0 ? nullptr : galaxy.planets[connections->source[connection]];
+}
+//**********************************************END OF SCANSEARCH CLASS**********************************************//
+
+//**********************************************START OF BATCHSCANSEARCH CLASS**********************************************//
+
+/*
+Precondition: The galaxy has been frozen; width is 8, 16 or 32
+Postcondition: None
+*/
+BatchScanSearch::BatchScanSearch(const Galaxy & galaxy, int width) : galaxy(galaxy), connections(nullptr), width(width),
+	first(0), count(0), arrival(galaxy.planets.size() * size_t(width), MAX_TIME),
+	arrived_by(galaxy.planets.size() * size_t(width), -1), last_scanned(galaxy.fleet.size(), -1), aboard(galaxy.fleet.size(), 0)
+{
+}
+
+/*
+Precondition: The workspace has been reset
+Postcondition: None
+ScanSearch::scan() for every lane in one pass. A lane boards a connection from a planet it 
+reached TRANSFER_TIME before the departure, or stays aboard if it took the ship's last connection 
+scanned and that one arrived where this one departs, TURNAROUND_TIME before it (see 
+ScanSearch::scan()). Each origin is reached at hour 0, so every scanned connection can be 
+boarded there. The pass ends at the first connection departing after 
+every lane has reached every planet. 
+*/
+void BatchScanSearch::search(int first, int count)
+{
+	connections = &galaxy.connections();
+	const Connections& c = *connections;
+	this->first = first;
+	this->count = count;
+	scanned_before.resize(c.size());
+	for (int k = 0; k < count; k++) {
+		arrival[size_t(first + k) * width + k] = 0;
+	}
+	STAT_ADD(counters.searches, count);
+
+	Time last = MAX_TIME; //No connection departing after this can improve an arrival. 
+	size_t cells = galaxy.planets.size() * count;
+	size_t reached = count;
+	for (int i = c.first(TRANSFER_TIME); i < c.size() && c.departure_time[i] < last; i++) {
+		STAT_ADD(counters.connections_scanned, 1);
+		int source = c.source[i];
+		int ship = c.id[i];
+		int previous = last_scanned[ship];
+		uint32_t take = lanes_below(&arrival[size_t(source) * width], width, c.departure_time[i] - TRANSFER_TIME + 1);
+		if (previous >= 0 && c.destination[previous] == source &&
+			c.arrival_time[previous] + TURNAROUND_TIME <= c.departure_time[i]) {
+			take |= aboard[ship];
+		}
+		scanned_before[i] = previous;
+		last_scanned[ship] = i;
+		aboard[ship] = take;
+		if (!take) {
+			continue;
+		}
+		size_t destination = size_t(c.destination[i]) * width;
+		uint32_t improved = take & ~lanes_below(&arrival[destination], width, c.arrival_time[i] + 1);
+		STAT_ADD(counters.relaxations, __builtin_popcount(improved));
+		for (; improved; improved &= improved - 1) {
+			int k = __builtin_ctz(improved);
+			reached += arrival[destination + k] == MAX_TIME;
+			arrival[destination + k] = c.arrival_time[i];
+			arrived_by[destination + k] = i;
+		}
+		if (reached == cells && last == MAX_TIME) {
+			last = 0;
+			for (size_t p = 0; p < galaxy.planets.size(); p++) {
+				last = max(last, *max_element(&arrival[p * width], &arrival[p * width] + count));
+			}
+		}
+	}
+}
+
+/*
+Precondition: None
+Postcondition: None
+*/
+void BatchScanSearch::reset()
+{
+	fill(arrival.begin(), arrival.end(), MAX_TIME);
+	fill(arrived_by.begin(), arrived_by.end(), -1);
+	fill(last_scanned.begin(), last_scanned.end(), -1);
+	fill(aboard.begin(), aboard.end(), 0);
+	count = 0;
+}
+
+/*
+Precondition: A search has run
+Postcondition: Returns the furthest planet from lane k's origin, as ScanSearch::search() does
+*/
+Planet * BatchScanSearch::furthest(int k) const
+{
+	int latest = first + k;
+	for (size_t p = 0; p < galaxy.planets.size(); p++) {
+		Time time = arrival[p * width + k];
+		if (time != MAX_TIME && time >= arrival[size_t(latest) * width + k]) {
+			latest = p;
+		}
+	}
+	return galaxy.planets[latest];
+}
+
+/*
+Precondition: A search has run
+Postcondition: The itinerary holds lane k's route to the destination
+See ScanSearch::make_itinerary(). A lane that could not have boarded a connection stayed aboard, 
+so it took the ship's connection scanned before it. 
+*/
+void BatchScanSearch::make_itinerary(int k, Planet * destination, Itinerary & schedule) const
+{
+	const Connections& c = *connections;
+	int origin = first + k;
+	schedule.origin = galaxy.planets[origin];
+	schedule.destinations.clear();
+	schedule.legs.clear();
+	int connection = arrived_by[size_t(destination->index) * width + k];
+	while (connection >= 0) {
+		schedule.destinations.push_back(galaxy.planets[c.destination[connection]]);
+		schedule.legs.push_back(Leg(c.id[connection], c.departure_time[connection], c.arrival_time[connection]));
+		int source = c.source[connection];
+		if (source == origin) {
+			break;
+		}
+		bool board = arrival[size_t(source) * width + k] + TRANSFER_TIME <= c.departure_time[connection];
+		connection = board ? arrived_by[size_t(source) * width + k] : scanned_before[connection];
+	}
+	schedule.destinations.push_back(schedule.origin);
+	schedule.legs.push_back(Leg(-1, 0, 0)); //Home planet
+}
+
+/*
+Precondition: None
+Postcondition: Returns a planet lane k did not reach, or nullptr
+*/
+Planet * BatchScanSearch::unreachable(int k) const
+{
+	for (size_t p = 0; p < galaxy.planets.size(); p++) {
+		if (arrival[p * width + k] == MAX_TIME) {
+			return galaxy.planets[p];
+		}
+	}
+	return nullptr;
+}
+
+/*
+Precondition: None
+Postcondition: Returns the leg, the origin's leg for the origin or Leg() if not reached
+*/
+Leg BatchScanSearch::best_leg(int k, const Planet * planet) const
+{
+	int connection = arrived_by[size_t(planet->index) * width + k];
+	if (connection < 0) {
+		return planet->index == first + k && k < count ? Leg(-1, 0, 0) : Leg();
+	}
+	const Connections& c = *connections;
+	return Leg(c.id[connection], c.departure_time[connection], c.arrival_time[connection]);
+}
+
+/*
+Precondition: None
+Postcondition: Returns a planet or nullptr
+*/
+Planet * BatchScanSearch::getPred(int k, const Planet * planet) const
+{
+	int connection = arrived_by[size_t(planet->index) * width + k];
+	return connection < 0 ? nullptr : galaxy.planets[connections->source[connection]];
+}
+//**********************************************END OF BATCHSCANSEARCH CLASS**********************************************//
+
+//**********************************************START OF RAPTORSEARCH CLASS**********************************************//
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: None
+*/
+RaptorSearch::RaptorSearch(const Galaxy & galaxy) : galaxy(galaxy), trips(nullptr), origin(nullptr), origin_ready(0),
+	arrival(galaxy.planets.size(), MAX_TIME), arrived_by(galaxy.planets.size(), -1), latest(galaxy.planets.size(), -1),
+	is_improved(galaxy.planets.size(), 0), last(MAX_TIME), horizon(MAX_TIME), span(HORIZON)
+{
+}
+
+/*
+Precondition: The workspace has been reset
+Postcondition: Returns the furthest planet by arrival time
+See ScanSearch::search(Planet * origin). 
+*/
+Planet * RaptorSearch::search(Planet * origin)
+{
+	this->origin = origin;
+	origin_leg = Leg(-1, 0, 0); //Home planet
+	STAT_ADD(counters.searches, 1);
+	run(TRANSFER_TIME, -1, -1, span);
+	return furthest();
+}
+
+/*
+Precondition: None
+Postcondition: Returns the furthest planet by arrival time
+*/
+Planet * RaptorSearch::search(Planet * origin, Time departure)
+{
+	reset();
+	this->origin = origin;
+	origin_leg = Leg(-1, departure, departure);
+	STAT_ADD(counters.searches, 1);
+	run(departure, -1, -1, span);
+	return furthest();
+}
+
+/*
+Precondition: A search has run
+Postcondition: Returns the furthest planet by arrival time
+*/
+Planet * RaptorSearch::furthest() const
+{
+	int latest = origin->index;
+	for (int planet : touched_planets) {
+		if (arrival[planet] > arrival[latest] || (arrival[planet] == arrival[latest] && planet > latest)) {
+			latest = planet;
+		}
+	}
+	return galaxy.planets[latest];
+}
+
+/*
+Precondition: None
+Postcondition: Returns the arrival time at the destination or MAX_TIME
+*/
+Time RaptorSearch::query(Planet * origin, Planet * destination, Time departure)
+{
+	reset();
+	this->origin = origin;
+	origin_leg = Leg(-1, departure, departure);
+	STAT_ADD(counters.searches, 1);
+	run(departure, destination->index, -1, span);
+	return arrival[destination->index];
+}
+
+/*
+Precondition: None
+Postcondition: Returns the journeys, fewest transfers first
+Each round that improved the destination, and so each number of trips, arrived earlier than any 
+round before it. Within a round only the last improvement counts. 
+*/
+vector<RaptorSearch::Journey> RaptorSearch::journeys(Planet * origin, Planet * destination, Time departure, int max_transfers)
+{
+	reset();
+	this->origin = origin;
+	origin_leg = Leg(-1, departure, departure);
+	STAT_ADD(counters.searches, 1);
+	run(departure, destination->index, max_transfers < 0 ? -1 : max_transfers + 1, MAX_TIME);
+	vector<Journey> result;
+	for (int label = latest[destination->index]; label >= 0; label = labels[label].previous) {
+		if (!result.empty() && result.back().transfers == labels[label].round - 1) {
+			continue;
+		}
+		result.push_back(Journey{ labels[label].round - 1, Itinerary() });
+		make_journey(label, result.back().itinerary);
+	}
+	reverse(result.begin(), result.end());
+	return result;
+}
+
+/*
+Precondition: origin and origin_leg are set
+Postcondition: None
+Only legs departing before a horizon are ridden, starting span hours after ready: the arrivals 
+found by then are exact, since a better itinerary would only take earlier legs. Until the 
+target (every planet without one) is reached by the horizon, the rounds start over with the 
+span doubled. Ships sail for the whole schedule, so without a horizon the first rounds would 
+ride every boarded ship to the end of it. The span that sufficed is where the next search 
+starts. 
 */
-void Reader::timeScheduleDump()
+void RaptorSearch::run(Time ready, int target, int rounds, Time span)
 {
-	for (auto const &ent1 : travelTimes) { //Iterates through the map<string, map<string, int> 
-		auto const &outerKey = ent1.first;
-		auto const &inner_map = ent1.second;
-		for (auto const &ent2 : inner_map) {
-			auto const &innerKey = ent2.first;
-			auto const &innerVal = ent2.second;
-			cerr << "First: " << outerKey << ", Second: " << innerKey << ", Weight: " << innerVal << endl;
+	trips = &galaxy.trips();
+	first.resize(trips->size(), INT_MAX);
+	boarded.resize(trips->size(), INT_MAX);
+	origin_ready = ready;
+	for (;;) {
+		horizon = span >= trips->last_departure - ready ? MAX_TIME : ready + span;
+		explore(target, rounds);
+		Time reached = target >= 0 ? arrival[target] : touched_planets.size() == arrival.size() ? last : MAX_TIME;
+		if (horizon == MAX_TIME || reached <= horizon) {
+			if (horizon != MAX_TIME) {
+				this->span = span;
+			}
+			return;
 		}
+		clear();
+		span = span > MAX_TIME / 2 ? MAX_TIME : 2 * span;
 	}
 }
 
 /*
-Precondition: None
+Precondition: The workspace is clear
 Postcondition: None
-Creates the time schedule. 
-Creates the graph while validating with the time schedule. 
-Returns the graph.
+Round k boards every trip at the first leg the traveller can catch from a planet improved in 
+round k - 1 (the origin for round 1), then rides the trips. Runs until a round improves no 
+planet. 
 */
-Galaxy * Reader::load()
+void RaptorSearch::explore(int target, int rounds)
 {
-	createTimeSchedule();
-	createGraph();
-	return galaxy;
+	const Trips& t = *trips;
+	arrival[origin->index] = origin_leg.arrival_time;
+	touched_planets.push_back(origin->index);
+	marked.assign(1, origin->index);
+	last = MAX_TIME;
+
+	for (int round = 1; !marked.empty() && round != rounds + 1; round++) {
+		STAT_ADD(counters.rounds, 1);
+		for (int planet : marked) {
+			Time catchable = planet == origin->index ? origin_ready : arrival[planet] + TRANSFER_TIME;
+			Time bound = std::min(target >= 0 ? arrival[target] : last, horizon);
+			auto leg = std::lower_bound(t.departures.begin() + t.departure_begin[planet], t.departures.begin() + t.departure_begin[planet + 1],
+				catchable, [&](int i, Time time) { return t.departure_time[i] < time; });
+			for (; leg != t.departures.begin() + t.departure_begin[planet + 1] && t.departure_time[*leg] < bound; ++leg) {
+				STAT_ADD(counters.legs_examined, 1);
+				int trip = t.trip[*leg];
+				if (*leg >= boarded[trip] || *leg >= first[trip]) {
+					continue;
+				}
+				if (first[trip] == INT_MAX) {
+					queued.push_back(trip);
+				}
+				first[trip] = *leg;
+			}
+		}
+		for (int trip : queued) {
+			int from = first[trip];
+			first[trip] = INT_MAX;
+			ride(trip, from, round, target);
+		}
+		queued.clear();
+		for (int planet : improved) {
+			is_improved[planet] = 0;
+		}
+		marked.swap(improved);
+		improved.clear();
+		if (target < 0 && last == MAX_TIME && touched_planets.size() == arrival.size()) {
+			last = *max_element(arrival.begin(), arrival.end());
+		}
+	}
 }
 
 /*
-Precondition: None
+Precondition: Leg from of the trip can be caught in this round
 Postcondition: None
-Creates time schedule from conduits. Utilized for validating the creation
-of the graph. 
+Stops where an earlier round boarded the trip, since from there on it arrives nowhere earlier 
+than it did then, and at the first leg departing after the bound or the horizon. 
 */
-void Reader::createTimeSchedule()
+void RaptorSearch::ride(int trip, int from, int round, int target)
 {
-	string startPlanet = "";
-	string endPlanet = "";
-	string weight;
-	int tabCount = 0;
-	char letter;
-	while ((letter = inFile.get())) {
-		if (letter == '\t') {
-			tabCount++;
-			continue;
+	const Trips& t = *trips;
+	int end = std::min(t.begin[trip + 1], boarded[trip]);
+	if (boarded[trip] == INT_MAX) {
+		touched_trips.push_back(trip);
+	}
+	boarded[trip] = from;
+	for (int leg = from; leg < end; leg++) {
+		Time bound = std::min(target >= 0 ? arrival[target] : last, horizon);
+		if (t.departure_time[leg] >= bound) {
+			break;
 		}
-		if (letter == '\n') {
-			tabCount = 0;
-			travelTimes[endPlanet][startPlanet] = stoi(weight);
-			travelTimes[startPlanet][endPlanet] = stoi(weight);
-
-			startPlanet = "";
-			endPlanet = "";
-			weight = "";
+		STAT_ADD(counters.connections_scanned, 1);
+		int destination = t.destination[leg];
+		if (t.arrival_time[leg] >= arrival[destination] || t.arrival_time[leg] >= bound) {
 			continue;
 		}
-		if (tabCount == 0) { //Get the start planet
-			startPlanet.push_back(letter);
+		STAT_ADD(counters.relaxations, 1);
+		if (arrival[destination] == MAX_TIME) {
+			touched_planets.push_back(destination);
 		}
-		else if (tabCount == 1) { //Get the end planet
-			endPlanet.push_back(letter);
+		arrival[destination] = t.arrival_time[leg];
+		arrived_by[destination] = leg;
+		labels.push_back(Label{ round, from, leg, latest[destination] });
+		latest[destination] = labels.size() - 1;
+		if (!is_improved[destination]) {
+			is_improved[destination] = 1;
+			improved.push_back(destination);
 		}
-		else if (tabCount == 2) { //Get the weight
-			weight.push_back(letter);
-		}
-		if (letter == EOF) break;
 	}
-	inFile.close();
 }
 
 /*
 Precondition: None
-Postcondition: Returns a bool
-Updates the current leg information.
+Postcondition: None
 */
-bool Reader::get_record()
+void RaptorSearch::reset()
 {
-	if (route.eof()) { //end of file
-		route.close();
-		return false;
+	clear();
+	origin = nullptr;
+}
+
+/*
+Precondition: None
+Postcondition: None
+Clears the planets and trips the last search reached. 
+*/
+void RaptorSearch::clear()
+{
+	for (int planet : touched_planets) {
+		arrival[planet] = MAX_TIME;
+		arrived_by[planet] = -1;
+		latest[planet] = -1;
 	}
-	else {
-		getline(route, currentLeg);
-		while (currentLeg.empty() || currentLeg[0] == '#' || currentLeg[0] == '\n') {
-			getline(route, currentLeg); 
-		}
+	for (int trip : touched_trips) {
+		boarded[trip] = INT_MAX;
 	}
-	return true;
+	touched_planets.clear();
+	touched_trips.clear();
+	labels.clear();
 }
 
 /*
 Precondition: None
-Postcondition: Returns a bool
-Checks the current leg information and validates the current leg information with the previos leg information. 
+Postcondition: Returns the itinerary in the same form as Search::make_itinerary()
 */
-bool Reader::validate()
+Itinerary * RaptorSearch::make_itinerary(Planet * destination)
 {
-	int hours;
-	if (!previous_destination_planet) { //Special case. First departure. 
-		return true;
-	}
-	else {
-		if (ship_id != previous_ship_id) { //Start of another ship's route.  
-			return true;
-		}
-		else {
-			hours = travelTimes[departure_planet->name][destination_planet->name];
-			//Checks if it takes the right amount of time to travel from planet A to planet B 
-			if (!(departure_time + hours == arrival_time)) { 
-				return false;
-			}
-			if (previous_arrival_time + MIN_LAYOVER_TIME > departure_time) { //Checks that the minimum layover time has been waited. 
-				return false;
-			}
-			if (previous_destination_planet != departure_planet) { //Should leave from the same planet the ship arrived at. 
-				return false;
-			}
-		}
+	Itinerary* schedule = new Itinerary();
+	make_itinerary(destination, *schedule);
+	return schedule;
+}
+
+/*
+Precondition: None
+Postcondition: The itinerary holds the route to the destination
+Walks back through the leg arriving first at each planet, as ScanSearch::make_itinerary() does 
+when the traveller could have changed ships: the earliest arrival at the planet a leg leaves 
+from is always in time for it. 
+*/
+void RaptorSearch::make_itinerary(Planet * destination, Itinerary & schedule)
+{
+	const Trips& t = *trips;
+	schedule.origin = origin;
+	schedule.destinations.clear();
+	schedule.legs.clear();
+	for (int leg = arrived_by[destination->index]; leg >= 0; leg = arrived_by[t.source[leg]]) {
+		schedule.destinations.push_back(galaxy.planets[t.destination[leg]]);
+		schedule.legs.push_back(Leg(t.id[leg], t.departure_time[leg], t.arrival_time[leg]));
 	}
-	return true;
+	schedule.destinations.push_back(origin);
+	schedule.legs.push_back(origin_leg);
 }
 
 /*
 Precondition: None
-Postcondition: creates graph
-Parses the input file and creates the graph based on the leg information passed in.
-Validates with the conduit.txt file. 
+Postcondition: The itinerary holds the route of the improvement
+The trip of an improvement in round k was boarded from the planet's improvement of an earlier 
+round, which is the one the walk continues from. 
 */
-void Reader::createGraph()
+void RaptorSearch::make_journey(int label, Itinerary & schedule) const
 {
-	//Edge* edge;
-	string startPlanet, destPlanet, ship;
-	int dept, arrival;
-	while (get_record()) {
-		//Parsing the information since each element is separated by a tab key. 
-		ship = currentLeg.substr(0, currentLeg.find('\t'));
-		currentLeg = currentLeg.substr(currentLeg.find('\t') + 1);
-		startPlanet = currentLeg.substr(0, currentLeg.find('\t'));
-		currentLeg = currentLeg.substr(currentLeg.find('\t') + 1);
-		dept = stoi(currentLeg.substr(0, currentLeg.find('\t')));
-		currentLeg = currentLeg.substr(currentLeg.find('\t') + 1);
-		destPlanet = currentLeg.substr(0, currentLeg.find('\t'));
-		currentLeg = currentLeg.substr(currentLeg.find('\t') + 1);
-		arrival = stoi(currentLeg);
-
-		//Setting current leg information
-		if (planets.find(startPlanet) == planets.end()) {
-			departure_planet = new Planet(startPlanet);
-			planets[startPlanet] = departure_planet;
-		}
-		else {
-			departure_planet = planets[startPlanet];
-		}
-		if (planets.find(destPlanet) == planets.end()) {
-			destination_planet = new Planet(destPlanet);
-			planets[destPlanet] = destination_planet;
+	const Trips& t = *trips;
+	schedule.origin = origin;
+	schedule.destinations.clear();
+	schedule.legs.clear();
+	while (label >= 0) {
+		const Label& ride = labels[label];
+		for (int leg = ride.leg; leg >= ride.board; leg--) {
+			schedule.destinations.push_back(galaxy.planets[t.destination[leg]]);
+			schedule.legs.push_back(Leg(t.id[leg], t.departure_time[leg], t.arrival_time[leg]));
 		}
-		else {
-			destination_planet = planets[destPlanet];
-		}
-		departure_time = dept;
-		arrival_time = arrival;
-		if (ships.find(ship) == ships.end()) {
-			ship_id = ships[ship] = galaxy->fleet.add(ship);
+		label = latest[t.source[ride.board]];
+		while (label >= 0 && labels[label].round >= ride.round) {
+			label = labels[label].previous;
 		}
+	}
+	schedule.destinations.push_back(origin);
+	schedule.legs.push_back(origin_leg);
+}
 
-		//Validating current leg. 
-		if (validate()) {
-			Leg current(ships[ship], dept, arrival);
-			if (edges[planets[startPlanet]].find(planets[destPlanet]) == edges[planets[startPlanet]].end()) {
-				edges[departure_planet][destination_planet] = new Edge(destination_planet);
-				edges[departure_planet][destination_planet]->add(current);
-				planets[startPlanet]->add(edges[departure_planet][destination_planet]);
-			}
-			else {
-				edges[departure_planet][destination_planet]->add(current);
-			}
-			//Set previous leg information for validation. 
-			previous_ship_id = ship_id;
-			previous_destination_planet = destination_planet;
-			previous_arrival_time = arrival_time;
-		}
-		else { //Set of information that caused the error 
-			cerr << "Invalid input. Current Leg displayed below is not well-formed!" << endl; 
-			cerr << galaxy->fleet.name(ship_id) << " " << departure_planet->name << " " << destination_planet->name << " " << departure_time << " " << arrival_time << endl;
-			exit(EXIT_FAILURE);
+/*
+Precondition: None
+Postcondition: Returns a planet or nullptr
+*/
+Planet * RaptorSearch::unreachable() const
+{
+	for (unsigned int i = 0; i < arrival.size(); i++) {
+		if (arrival[i] == MAX_TIME) {
+			return galaxy.planets[i];
 		}
 	}
-	route.close();
-	for (auto const &plan : planets) {
-		auto const &val = plan.second;
-		galaxy->add(val);
-	}
+	return nullptr;
 }
-//**********************************************END OF READER CLASS**********************************************//
 
+/*
+Precondition: None
+Postcondition: None
+See Search::outputAllRoutes(). 
+*/
+void RaptorSearch::outputAllRoutes(Planet * destination, Fleet & fleet, RouteWriter & out)
+{
+	make_itinerary(destination, route);
+	out.write(route, fleet);
+}
 
-//**********************************************START OF GALAXY CLASS**********************************************//
+/*
+Precondition: None
+Postcondition: Returns the leg, the origin's leg for the origin or Leg() if not reached
+*/
+Leg RaptorSearch::best_leg(const Planet * planet) const
+{
+	int leg = arrived_by[planet->index];
+	if (leg < 0) {
+		return planet == origin ? origin_leg : Leg();
+	}
+	const Trips& t = *trips;
+	return Leg(t.id[leg], t.departure_time[leg], t.arrival_time[leg]);
+}
 
 /*
 Precondition: None
+Postcondition: Returns a planet or nullptr
+*/
+Planet * RaptorSearch::getPred(const Planet * planet) const
+{
+	int leg = arrived_by[planet->index];
+	return leg < 0 ? nullptr : galaxy.planets[trips->source[leg]];
+}
+//**********************************************END OF RAPTORSEARCH CLASS**********************************************//
+
+//**********************************************START OF SEARCH CLASS**********************************************//
+
+/*
+Precondition: The galaxy has been frozen
 Postcondition: None
-Checks if any planets are unreachable by testing if their best_leg's arrival time is 
-MAX_TIME or not. Will exit program if so (Graph is not well formed). 
+Creates one label per planet of the galaxy and sizes the selected queue. 
 */
-void Galaxy::checkAllPlanets()
+Search::Search(const Galaxy & galaxy, QueueKind kind) : galaxy(galaxy), origin(nullptr), origin_ready(0),
+	potential(nullptr), bound_target(-1), bound_generation(0), kind(kind)
 {
-	for (unsigned int i = 0; i < planets.size(); i++) {
-		if (planets[i]->arrival_time() == MAX_TIME) {
-			cerr << "PLANET: " << planets[i]->name << ", IS UNREACHABLE!" << endl; 
-			exit(EXIT_FAILURE);
-		}
+	labels.resize(galaxy.compact.planet_count());
+	for (auto& label : labels) {
+		label.predecessor = -1;
+		label.best_leg = Leg();
+		label.settled = false;
+	}
+	switch (kind) {
+	case BINARY_HEAP: binary_heap.resize(labels.size()); break;
+	case QUATERNARY_HEAP: quaternary_heap.resize(labels.size()); break;
+	case RADIX_HEAP: radix_heap.resize(labels.size()); break;
 	}
 }
 
 /*
 Precondition: None
 Postcondition: None
-Runs Dijkstra's algorithm on each planet utilizing a priority queue. 
-Will push all elements into the queue, and get the furthest planet
-away from this home planet through dijkstra's algorithm.
+Clears the labels touched by the last search so the workspace can be used for another origin. 
 */
-void Galaxy::search()
+void Search::reset()
 {
-	Planet* furthest; //Furthest planet from the home planet. 
-	Itinerary* schedule;
-	PriorityQueue<Planet, int(*)(Planet*, Planet*)> queue(Planet::compare);
-	for (unsigned int i = 0; i < planets.size(); i++) {
-		//Pushes all planets back into the priority queue
-		for (unsigned int j = 0; j < planets.size(); j++) {
-			queue.push_back(planets[j]);
-		}
-		furthest = planets[i]->search(queue); 
-		schedule = planets[i]->make_itinerary(furthest);
+	for (int planet : touched) {
+		labels[planet].predecessor = -1;
+		labels[planet].best_leg = Leg();
+		labels[planet].settled = false;
+	}
+	touched.clear();
+	origin = nullptr;
+}
 
-		//This for-loop will print out all of the itineraries possible. 
-		//Commented out but was ran once pre-submission just as an additional file to see and compare with. 
-		//May rerun. Intentionally left out in the final submission to ensure better run-time. 
-		/*for (unsigned int j = 0; j < planets.size(); j++) {
-			if (j != i) {
-				planets[i]->outputAllRoutes(planets[j], fleet);
-			}
-		}*/
+/*
+Precondition: The workspace has been reset
+Postcondition: Returns the furthest planet 
+Part of dijkstra's algorithm from Galaxy::search() 
+*/
+Planet * Search::search(Planet * origin)
+{
+	this->origin = origin;
+	label(origin->index).best_leg = Leg(-1, 0, 0); //Home planet
+	origin_ready = TRANSFER_TIME;
+	potential = nullptr;
+	STAT_ADD(counters.searches, 1);
+	return galaxy.planets[run(-1)];
+}
 
-		//planets[i]->dumpPredecessors();
-		schedule->print(this, fleet); 
-		checkAllPlanets(); //Checks if all planets are reachable. 
-		this->reset();
-		delete schedule;
-	}
+/*
+Precondition: None
+Postcondition: Returns the furthest planet by travel time
+See search(Planet * origin) and query(). 
+*/
+Planet * Search::search(Planet * origin, Time departure)
+{
+	reset();
+	this->origin = origin;
+	label(origin->index).best_leg = Leg(-1, departure, departure);
+	origin_ready = departure;
+	potential = nullptr;
+	STAT_ADD(counters.searches, 1);
+	return galaxy.planets[run(-1)];
 }
 
 /*
 Precondition: None
-Postcondition: None
-Dumps out the planets.
+Postcondition: Returns the arrival time at the destination or MAX_TIME
+Resets the workspace, then runs dijkstra's algorithm from the origin until the destination 
+is settled. 
 */
-void Galaxy::dump()
+Time Search::query(Planet * origin, Planet * destination, Time departure, bool pruned)
 {
-	for (unsigned int i = 0; i < planets.size(); i++) {
-		planets[i]->dump(this);
+	reset();
+	potential = nullptr;
+	if (pruned) {
+		if (!has_bounds(destination)) {
+			compute_bounds(destination->index);
+		}
+		potential = lower_bound.data();
+		if (potential[origin->index] == MAX_TIME) {
+			return MAX_TIME;
+		}
 	}
+	this->origin = origin;
+	label(origin->index).best_leg = Leg(-1, departure, departure);
+	origin_ready = departure;
+	STAT_ADD(counters.searches, 1);
+	run(destination->index);
+	return labels[destination->index].best_leg.arrival_time;
 }
-//**********************************************END OF GALAXY CLASS**********************************************//
 
-//**********************************************START OF PLANET CLASS**********************************************//
+/*
+Precondition: None
+Postcondition: Returns true if the lower bounds to the destination are current
+*/
+bool Search::has_bounds(const Planet * destination) const
+{
+	return bound_target == destination->index && bound_generation == galaxy.generation;
+}
 
 /*
 Precondition: None
-Postcondition: Returns the furthest planet 
-Part of dijkstra's algorithm from Galaxy::search() 
-Will get the furthest planet (Last planet in the queue) and return that. 
+Postcondition: Returns the index of the planet settled last
+Runs the algorithm with the queue backend chosen at construction. 
+*/
+int Search::run(int target)
+{
+	switch (kind) {
+	case QUATERNARY_HEAP: return dijkstra(quaternary_heap, target);
+	case RADIX_HEAP: return dijkstra(radix_heap, target);
+	default: return dijkstra(binary_heap, target);
+	}
+}
+
+/*
+Precondition: origin, origin_ready and the home planet's label have been set
+Postcondition: Returns the index of the planet settled last 
+Only the home planet is pushed up front; other planets enter the queue when first reached. 
+The last planet settled is the furthest one no matter what due to Dijkstra's algorithm. 
+Queues that cannot lower a key in place may hand back a planet again, which is skipped. 
+The home planet is keyed without its lower bound so keys never decrease. 
 */
-Planet * Planet::search(PriorityQueue<Planet, int(*)(Planet*, Planet*)>& queue)
+template<typename Queue>
+int Search::dijkstra(Queue & queue, int target)
 {
-	best_leg = Leg(-1, 0, 0); //Home planet
-	Planet* furthest = this; //Unitialized pointer error otherwise. Needs some form of memory to hold onto. 
-	Planet* current;
-	queue.reduce(this); //Sift the home planet to top of queue. 
+	int home = origin->index;
+	int furthest = home;
+	queue.push(home, labels[home].best_leg.arrival_time);
+	STAT_ADD(counters.queue_pushes, 1);
 	while (!queue.empty()) {
-		current = queue.pop();
-		if (queue.empty()) { //Last element in the queue is the farthest planet no matter what due to Dijkstra's algorithm 
-			furthest = current; 
+		int current = queue.pop();
+		STAT_ADD(counters.queue_pops, 1);
+		if (labels[current].settled) {
+			STAT_ADD(counters.stale_pops, 1);
+			continue;
+		}
+		labels[current].settled = true;
+		furthest = current;
+		if (current == target) { //Early termination: the destination's arrival time is final. 
+			queue.clear();
 			break;
 		}
-		current->relax_neighbors(queue);
+		Time ready = current == home ? origin_ready : labels[current].best_leg.arrival_time + TRANSFER_TIME;
+		relax_neighbors(current, ready, queue);
 	}
 	return furthest;
 }
 
+/*
+Precondition: None
+Postcondition: lower_bound holds, for every planet, a lower bound on the time needed to reach 
+the target from it (MAX_TIME if it cannot). 
+Dijkstra's algorithm backwards from the target over the minimum flight time of every edge, 
+plus TRANSFER_TIME for every stop before the target. 
+*/
+void Search::compute_bounds(int target)
+{
+	const CompactGalaxy& compact = galaxy.compact;
+	lower_bound.assign(labels.size(), MAX_TIME);
+	bound_heap.resize(labels.size());
+	bound_done.assign(labels.size(), false);
+	lower_bound[target] = 0;
+	bound_heap.push(target, 0);
+	while (!bound_heap.empty()) {
+		int current = bound_heap.pop();
+		if (bound_done[current]) {
+			continue;
+		}
+		bound_done[current] = true;
+		Time stop = current == target ? 0 : TRANSFER_TIME;
+		for (int r = compact.reverse_begin[current]; r < compact.reverse_begin[current + 1]; r++) {
+			int e = compact.reverse_edge[r];
+			int source = compact.edge_source[e];
+			Time shortest = compact.shortest(e);
+			if (shortest == MAX_TIME) { //No legs left on this edge. 
+				continue;
+			}
+			Time bound = lower_bound[current] + stop + shortest;
+			if (bound < lower_bound[source]) {
+				lower_bound[source] = bound;
+				bound_heap.push(source, bound);
+			}
+		}
+	}
+	bound_target = target;
+	bound_generation = galaxy.generation;
+}
+
+/*
+Precondition: None
+Postcondition: Returns a planet or nullptr
+Checks if any planets are unreachable by testing if their best_leg's arrival time is 
+MAX_TIME or not. 
+*/
+Planet * Search::unreachable() const
+{
+	for (unsigned int i = 0; i < labels.size(); i++) {
+		if (labels[i].best_leg.arrival_time == MAX_TIME) {
+			return galaxy.planets[i];
+		}
+	}
+	return nullptr;
+}
+
+/*
+Precondition: None
+Postcondition: Returns a planet or nullptr
+Returns the planet the given planet is reached from, nullptr for the origin and unreached planets. 
+*/
+Planet * Search::getPred(const Planet * planet) const
+{
+	int pred = labels[planet->index].predecessor;
+	return pred < 0 ? nullptr : galaxy.planets[pred];
+}
+
 /*
 Precondition: None
 Postcondition: None
 Will dump out the predecessors of the given planet to show the path. 
 Does not show times but the general schedule. 
 */
-void Planet::dumpPredecessors()
+void Search::dumpPredecessors(Planet* destination)
 {
-	Planet* pred = this; 
+	Planet* pred = destination; 
 	while (pred != nullptr) {
 		cerr << pred->name << endl; 
-		pred = pred->predecessor;
+		pred = getPred(pred);
 	}
 	cerr << endl; 
 }
@@ -322,16 +2745,10 @@ Helper method that printed out all the itineraries of every single planet.
 Cannot be run during the program. Requires a uncomment or explicit call
 somewhere inside the galaxy class methods.
 */
-void Planet::outputAllRoutes(Planet * destination, Fleet& fleet)
+void Search::outputAllRoutes(Planet * destination, Fleet& fleet, RouteWriter& out)
 {
-	Itinerary* schedule = new Itinerary(this); 
-	while (destination) {
-		schedule->destinations.push_back(destination);
-		schedule->legs.push_back(destination->best_leg);
-		destination = destination->predecessor;
-	}
-	schedule->printToFile(fleet);
-	delete schedule;
+	make_itinerary(destination, route); 
+	out.write(route, fleet);
 }
 
 /*
@@ -340,46 +2757,111 @@ Postcondition: Returns an itinerary
 Will create the itinerary based on the destination planet passed through and return it. 
 Does this by creating a parallel sequence of planets and legs.
 */
-Itinerary * Planet::make_itinerary(Planet * destination)
+Itinerary * Search::make_itinerary(Planet * destination)
+{
+	Itinerary* schedule = new Itinerary(); 
+	make_itinerary(destination, *schedule);
+	return schedule;
+}
+
+/*
+Precondition: None
+Postcondition: The itinerary holds the route to the destination
+Clears the itinerary without releasing its buffers and fills it as make_itinerary(Planet * destination). 
+*/
+void Search::make_itinerary(Planet * destination, Itinerary & schedule)
 {
-	Itinerary* schedule = new Itinerary(this); 
+	schedule.origin = origin;
+	schedule.destinations.clear();
+	schedule.legs.clear();
 	while(destination){
-		schedule->destinations.push_back(destination); 
-		schedule->legs.push_back(destination->best_leg); 
-		destination = destination->predecessor; 
+		schedule.destinations.push_back(destination); 
+		schedule.legs.push_back(labels[destination->index].best_leg); 
+		destination = getPred(destination); 
 	}
-	return schedule;
 }
 
 /*
 Precondition: None
 Postcondition: None
 Checks all neighbors to the given planet and does comparisons on the legs within the edge with the 
-best_leg of the destination planet. 
-*/
-void Planet::relax_neighbors(PriorityQueue<Planet, int(*)(Planet*, Planet*)>& queue)
-{
-	Time nextMin = best_leg.arrival_time + TRANSFER_TIME; //Arrival Time + 4 hours. 
-	Planet* destPlanet;
-	for (unsigned int i = 0; i < edges.size(); i++) {
-		edges[i]->sort(); //Will get the legs in ascending order. 
-		destPlanet = edges[i]->destination;
-		Leg bestLeg;
-		Leg current;
-		for (unsigned int j = 0; j < edges[i]->departures.size(); j++) {
-			current = edges[i]->departures[j];
-			if (current.departure_time >= nextMin) { //The first leg that follows this boolean expression is the lowest time for the leg. 
-				bestLeg = current;
-				break;  
-			}
+best_leg of the destination planet. Walks the planet's slice of the compact edge array and 
+looks each edge up in the pareto leg pool. 
+*/
+template<typename Queue>
+void Search::relax_neighbors(int planet, Time ready, Queue& queue)
+{
+	const CompactGalaxy& compact = galaxy.compact;
+	for (int e = compact.edge_begin[planet]; e < compact.edge_begin[planet + 1]; e++) {
+		int next = compact.edge_destination[e];
+		if (potential && potential[next] == MAX_TIME) { //Pruned: the destination cannot be reached from there. 
+			continue;
+		}
+		STAT_ADD(counters.edges_scanned, 1);
+		STAT_ADD(counters.legs_examined, compact.pareto_count(e));
+		Leg leg = compact.earliest_arrival(e, ready); //Earliest arrival among the legs we can still catch. 
+		Time arrival = leg.arrival_time;
+		if (arrival < labels[next].best_leg.arrival_time) { //Compares the best leg within the edge to the best leg of the planet. Replaces if necessary. 
+			STAT_ADD(counters.relaxations, 1);
+			STAT_ADD(labels[next].best_leg.arrival_time == MAX_TIME ? counters.queue_pushes : counters.queue_reduces, 1);
+			Label& dest = label(next);
+			dest.predecessor = planet; 
+			dest.best_leg = leg; 
+			queue.push(next, potential ? arrival + potential[next] : arrival); 
 		}
-		if (Leg::less_than(bestLeg, destPlanet->best_leg)) { //Compares the best leg within the edge to the best leg of the planet. Replaces if necessary. 
-			destPlanet->predecessor = this; 
-			destPlanet->best_leg = bestLeg; 
-			queue.reduce(destPlanet); 
+	}
+}
+//**********************************************END OF SEARCH CLASS**********************************************//
+
+//**********************************************START OF COMPACTGALAXY CLASS**********************************************//
+
+/*
+Precondition: Every edge of the galaxy has been finalized
+Postcondition: None
+Lays the planets' edges out in planet order and copies every edge's timetable and 
+Pareto view into the two contiguous leg pools. 
+*/
+CompactGalaxy::CompactGalaxy(const Galaxy & galaxy)
+{
+	edge_begin.push_back(0);
+	leg_begin.push_back(0);
+	pareto_begin.push_back(0);
+	for (Planet* planet : galaxy.planets) {
+		for (Edge* edge : planet->edges) {
+			edge_destination.push_back(edge->destination->index);
+			for (const Leg& leg : edge->departures) {
+				timetable.push_back(leg);
+			}
+			for (const Leg& leg : edge->pareto) {
+				pareto.push_back(leg);
+			}
+			leg_begin.push_back(timetable.size());
+			pareto_begin.push_back(pareto.size());
+			edge_source.push_back(planet->index);
+			min_duration.push_back(edge->shortest());
 		}
+		edge_begin.push_back(edge_destination.size());
 	}
+
+	//Reverse adjacency: bucket the edges by destination planet. 
+	std::vector<int> begin(planet_count() + 1, 0);
+	for (int e = 0; e < edge_count(); e++) {
+		begin[edge_destination[e] + 1]++;
+	}
+	for (int p = 0; p < planet_count(); p++) {
+		begin[p + 1] += begin[p];
+	}
+	std::vector<int> edges(edge_count());
+	std::vector<int> next(begin.begin(), begin.end() - 1);
+	for (int e = 0; e < edge_count(); e++) {
+		edges[next[edge_destination[e]]++] = e;
+	}
+	reverse_begin.adopt(std::move(begin));
+	reverse_edge.adopt(std::move(edges));
 }
+//**********************************************END OF COMPACTGALAXY CLASS**********************************************//
+
+//**********************************************START OF PLANET CLASS**********************************************//
 
 /*
 Precondition: None
@@ -401,13 +2883,102 @@ void Planet::dump(Galaxy * galaxy)
 //**********************************************START OF EDGE CLASS**********************************************//
 /*
 http://www.cplusplus.com/reference/algorithm/sort/ <--Credits to
-Takes Iterators begin() and end() of a vector and sorts the elements inside based 
-a boolean function passed in as a third argument. Algorithm is part of the Algorithm library
-and is intended to sort the elements of a vector in ascending order. 
+Precondition: All legs have been added to the edge
+Postcondition: departures is ordered by departure time and pareto holds the non-dominated legs
+Sorts the timetable once by departure time (stable, so ties keep schedule order). Then walks it backwards keeping only the legs 
+that arrive strictly earlier than every later-departing leg. The surviving legs are 
+ascending in both departure and arrival time. 
+*/
+void Edge::finalize()
+{
+	std::stable_sort(departures.begin(), departures.end(), Leg::departs_before);
+	prune();
+}
+
+/*
+Precondition: departures is ordered by departure time
+Postcondition: pareto holds the non-dominated legs
+*/
+void Edge::prune()
+{
+	pareto.clear();
+	Time earliest = MAX_TIME;
+	for (auto leg = departures.rbegin(); leg != departures.rend(); ++leg) {
+		if (leg->arrival_time < earliest) {
+			earliest = leg->arrival_time;
+			pareto.push_back(*leg);
+		}
+		else if (leg->arrival_time == earliest && leg->departure_time == pareto.back().departure_time) {
+			pareto.back() = *leg; //Identical times: the ship listed first in the schedule wins. 
+		}
+	}
+	std::reverse(pareto.begin(), pareto.end());
+}
+
+/*
+Precondition: finalize() has been called
+Postcondition: None
+Inserts the leg after any leg with the same times (as if it came last in the schedule). 
+*/
+void Edge::insert(const Leg & leg)
+{
+	departures.insert(std::upper_bound(departures.begin(), departures.end(), leg, Leg::departs_before), leg);
+	prune();
+}
+
+/*
+Precondition: finalize() has been called
+Postcondition: Returns true if a leg was removed
+*/
+bool Edge::remove(Ship_ID id, Time departure)
+{
+	auto leg = std::find_if(departures.begin(), departures.end(),
+		[&](const Leg& leg) { return leg.id == id && leg.departure_time == departure; });
+	if (leg == departures.end()) {
+		return false;
+	}
+	departures.erase(leg);
+	prune();
+	return true;
+}
+
+/*
+Precondition: finalize() has been called
+Postcondition: Returns the shortest flight time or MAX_TIME
+Only non-dominated legs need to be looked at: a dominated leg never flies faster than the leg dominating it. 
+*/
+Time Edge::shortest() const
+{
+	Time shortest = MAX_TIME;
+	for (const Leg& leg : pareto) {
+		shortest = std::min(shortest, leg.arrival_time - leg.departure_time);
+	}
+	return shortest;
+}
+
+/*
+Precondition: finalize() has been called
+Postcondition: Returns a pointer into the timetable or nullptr
+Binary search for the first leg departing at or after time t. 
+*/
+const Leg * Edge::earliest_departure(Time t) const
+{
+	auto leg = std::lower_bound(departures.begin(), departures.end(), t,
+		[](const Leg& leg, Time t) { return leg.departure_time < t; });
+	return leg == departures.end() ? nullptr : &*leg;
+}
+
+/*
+Precondition: finalize() has been called
+Postcondition: Returns a pointer into the Pareto view or nullptr
+Arrival times grow with departure times in the Pareto view, so the first usable 
+leg is also the one arriving first. 
 */
-void Edge::sort()
+const Leg * Edge::earliest_arrival(Time t) const
 {
-	std::sort(departures.begin(), departures.end(), Leg::less_than);
+	auto leg = std::lower_bound(pareto.begin(), pareto.end(), t,
+		[](const Leg& leg, Time t) { return leg.departure_time < t; });
+	return leg == pareto.end() ? nullptr : &*leg;
 }
 
 /*
@@ -438,37 +3009,54 @@ Will also write out to a file, the highest arrival time of a given pair of plane
 */
 void Itinerary::print(Galaxy* galaxy, Fleet & fleet, std::ostream & out)
 {
+	string text;
+	format(fleet, text);
 	//Prints the longest journey of a given planet to a file called 'sampleRoute.txt' 
-	if (destinations[0]->arrival_time() > galaxy->highestTime) {
-		galaxy->highestTime = destinations[0]->arrival_time();
+	if (legs[0].arrival_time > galaxy->highestTime) {
+		galaxy->highestTime = legs[0].arrival_time;
 		ofstream outFile("sampleRoute.txt");
-		for (int i = destinations.size() - 1; i > 0; i--) {
-			outFile << fleet.name(legs[i - 1].id) << '\t' << destinations[i]->name << '\t' << legs[i - 1].departure_time << '\t' << destinations[i - 1]->name << '\t' << legs[i - 1].arrival_time << endl;
-		}
+		outFile.write(text.data(), text.size());
 		outFile.close();
 	}
 
 	//Prints the longest-shortest path of each pairs of planets in the galaxy
-	for (int i = destinations.size() - 1; i > 0; i--) {
-		out << fleet.name(legs[i - 1].id) << '\t' << destinations[i]->name << '\t' << legs[i - 1].departure_time << '\t' << destinations[i - 1]->name << '\t' << legs[i - 1].arrival_time << endl;
-	}
-	out << endl;
+	text += '\n';
+	out.write(text.data(), text.size());
 }
 
 /*
 Precondition: None
 Postcondition: None
 Prints out the itinerary in the same format as Itinerary::print(Galaxy* galaxy, Fleet & fleet, std::ostream & out);
+Opens the file for every itinerary; use a RouteWriter (see output.h) for more than a few. 
 */
 void Itinerary::printToFile(Fleet& fleet)
 {
-	ofstream outFile("AllItineraries.txt", ios::out | ios::app);
-	for (unsigned int i = destinations.size() - 1; i > 0; i--) {
-		outFile << fleet.name(legs[i - 1].id) << '\t' << destinations[i]->name << '\t' << legs[i - 1].departure_time << '\t' << destinations[i - 1]->name << '\t' << legs[i - 1].arrival_time << endl;
-	}
-	outFile << endl; 
+	RouteWriter out("AllItineraries.txt", true);
+	out.write(*this, fleet);
+}
 
-	outFile.close(); 
+/*
+Precondition: None
+Postcondition: None
+Numbers are formatted with to_chars() and names copied as they are, so no stream is involved. 
+*/
+void Itinerary::format(const Fleet & fleet, string & text) const
+{
+	char number[16];
+	for (int i = destinations.size() - 1; i > 0; i--) {
+		const Leg& leg = legs[i - 1];
+		text += fleet.name(leg.id);
+		text += '\t';
+		text += destinations[i]->name;
+		text += '\t';
+		text.append(number, to_chars(number, number + sizeof(number), leg.departure_time).ptr);
+		text += '\t';
+		text += destinations[i - 1]->name;
+		text += '\t';
+		text.append(number, to_chars(number, number + sizeof(number), leg.arrival_time).ptr);
+		text += '\n';
+	}
 }
 
 //**********************************************END OF ITINERARY CLASS**********************************************//
@@ -0,0 +1,150 @@
+#include "generator.h"
+#include "galaxy.h"
+
+#include <fstream>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+/*
+Precondition: None
+Postcondition: Returns the name of planet i
+Names are zero-padded to the same width, so name order is index order.
+*/
+string planet_name(int i, int planets)
+{
+	string digits = to_string(i);
+	return "P" + string(to_string(planets - 1).size() - digits.size(), '0') + digits;
+}
+
+// Class LineWriter collects lines in a buffer and writes it out in large
+// blocks.
+class LineWriter {
+public:
+	LineWriter(ofstream& out) : out(out) {}
+	~LineWriter() { flush(); }
+
+	LineWriter& operator<<(const string& text) { buffer += text; return *this; }
+	LineWriter& operator<<(char c) { buffer += c; return *this; }
+	LineWriter& operator<<(long long value) { buffer += to_string(value); return *this; }
+	void end_line() {
+		buffer += '\n';
+		if (buffer.size() >= BLOCK) {
+			flush();
+		}
+	}
+	void flush() { out.write(buffer.data(), buffer.size()); buffer.clear(); }
+
+private:
+	static const size_t BLOCK = 1 << 20;
+	ofstream& out;
+	string buffer;
+};
+
+}
+
+/*
+Precondition: planets >= 2
+Postcondition: None
+*/
+Generator::Generator(int planets, long long legs, uint64_t seed) : planets(planets), legs(legs), state(seed), written(0)
+{
+}
+
+/*
+Precondition: None
+Postcondition: Returns the next pseudo-random number
+*/
+uint64_t Generator::next()
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if both files were written
+Draws the conduits first (ring, then chords, skipping pairs already joined), then the ring
+ship's two laps, then random ships until the requested number of legs has been written.
+*/
+bool Generator::write(const string & conduits, const string & routes)
+{
+	ofstream conduitFile(conduits);
+	ofstream routeFile(routes);
+	if (!conduitFile || !routeFile) {
+		return false;
+	}
+	vector<string> names(planets);
+	for (int i = 0; i < planets; i++) {
+		names[i] = planet_name(i, planets);
+	}
+
+	//Conduits, kept per planet for the random walks.
+	vector<vector<pair<int, Time>>> neighbors(planets);
+	unordered_set<uint64_t> joined;
+	vector<Time> ring(planets); //Travel time from planet i to planet i + 1.
+	{
+		LineWriter out(conduitFile);
+		auto join = [&](int from, int to) {
+			uint64_t key = (uint64_t(min(from, to)) << 32) | unsigned(max(from, to));
+			if (from == to || !joined.insert(key).second) {
+				return MAX_TIME;
+			}
+			Time hours = 1 + below(MAX_TRAVEL_TIME);
+			neighbors[from].push_back(make_pair(to, hours));
+			neighbors[to].push_back(make_pair(from, hours));
+			out << names[from] << '\t' << names[to] << '\t' << (long long)hours;
+			out.end_line();
+			return hours;
+		};
+		for (int i = 0; i < planets; i++) {
+			ring[i] = join(i, (i + 1) % planets);
+		}
+		if (planets == 2) {
+			ring[1] = ring[0];
+		}
+		for (int i = 0; i < planets; i++) {
+			for (int c = 0; c < CHORDS; c++) {
+				join(i, below(planets));
+			}
+		}
+	}
+
+	LineWriter out(routeFile);
+	written = 0;
+	auto leg = [&](const string& ship, int from, Time departure, int to, Time arrival) {
+		out << ship << '\t' << names[from] << '\t' << (long long)departure << '\t' << names[to] << '\t' << (long long)arrival;
+		out.end_line();
+		written++;
+	};
+
+	//The ring ship: two laps, waiting exactly TURNAROUND_TIME at every planet.
+	Time t = TRANSFER_TIME;
+	for (int i = 0; i < 2 * planets; i++) {
+		int from = i % planets;
+		leg("Ring", from, t, (from + 1) % planets, t + ring[from]);
+		t += ring[from] + TURNAROUND_TIME;
+	}
+	Time horizon = t;
+
+	//Random ships.
+	for (long long ship = 1; written < legs; ship++) {
+		string name = "S" + to_string(ship);
+		int at = below(planets);
+		Time departure = below(horizon);
+		for (int l = 0; l < LEGS_PER_SHIP && written < legs; l++) {
+			const pair<int, Time>& conduit = neighbors[at][below(neighbors[at].size())];
+			leg(name, at, departure, conduit.first, departure + conduit.second);
+			at = conduit.first;
+			departure += conduit.second + TURNAROUND_TIME + below(2 * TURNAROUND_TIME + 1);
+		}
+	}
+	out.flush();
+	return bool(conduitFile) && bool(routeFile);
+}
@@ -0,0 +1,78 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+Precondition: None
+Postcondition: The file is mapped read-only, or is_open() is false
+Maps the whole file and tells the kernel it will be read front to back. 
+*/
+MappedFile::MappedFile(const std::string & path) : data_(nullptr), size_(0), open_(false)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+	struct stat info;
+	if (fstat(fd, &info) == 0) {
+		size_ = info.st_size;
+		if (size_ == 0) {
+			open_ = true;
+		}
+		else {
+			void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map != MAP_FAILED) {
+				madvise(map, size_, MADV_SEQUENTIAL);
+				data_ = static_cast<const char*>(map);
+				open_ = true;
+			}
+			else {
+				size_ = 0;
+			}
+		}
+	}
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	unmap();
+}
+
+MappedFile::MappedFile(MappedFile && other) : data_(other.data_), size_(other.size_), open_(other.open_)
+{
+	other.data_ = nullptr;
+	other.size_ = 0;
+	other.open_ = false;
+}
+
+MappedFile & MappedFile::operator=(MappedFile && other)
+{
+	if (this != &other) {
+		unmap();
+		data_ = other.data_;
+		size_ = other.size_;
+		open_ = other.open_;
+		other.data_ = nullptr;
+		other.size_ = 0;
+		other.open_ = false;
+	}
+	return *this;
+}
+
+/*
+Precondition: None
+Postcondition: Nothing is mapped
+*/
+void MappedFile::unmap()
+{
+	if (data_) {
+		munmap(const_cast<char*>(data_), size_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+	open_ = false;
+}
@@ -0,0 +1,54 @@
+#include "output.h"
+
+using namespace std;
+
+/*
+Precondition: None
+Postcondition: None
+*/
+RouteWriter::RouteWriter(ostream & out) : out(out)
+{
+	block.reserve(BLOCK_SIZE);
+}
+
+/*
+Precondition: None
+Postcondition: is_open() tells whether the file could be opened
+*/
+RouteWriter::RouteWriter(const string & path, bool append) : file(path, append ? ios::out | ios::app : ios::out), out(file)
+{
+	block.reserve(BLOCK_SIZE);
+}
+
+/*
+Precondition: None
+Postcondition: None
+Formats outside the lock, so threads only wait for each other while copying whole itineraries.
+*/
+void RouteWriter::write(const Itinerary & itinerary, const Fleet & fleet, bool separate)
+{
+	thread_local string text;
+	text.clear();
+	itinerary.format(fleet, text);
+	if (separate) {
+		text += '\n';
+	}
+	lock_guard<mutex> guard(lock);
+	block += text;
+	if (block.size() >= BLOCK_SIZE) {
+		out.write(block.data(), block.size());
+		block.clear();
+	}
+}
+
+/*
+Precondition: None
+Postcondition: None
+*/
+void RouteWriter::flush()
+{
+	lock_guard<mutex> guard(lock);
+	out.write(block.data(), block.size());
+	out.flush();
+	block.clear();
+}
@@ -0,0 +1,289 @@
+#include "route_matrix.h"
+#include "binary_io.h"
+
+#include <charconv>
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[8] = { 'G', 'A', 'L', 'A', 'X', 'Y', 'A', 'P' };
+
+}  // namespace
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Holds the earliest arrivals and last legs of every pair of planets
+Each worker fills the rows of the origins it searches from, so no two threads write the same cell.
+*/
+void RouteMatrix::compute(const Galaxy & galaxy)
+{
+	start(galaxy);
+	int workers = galaxy.threads > 0 ? galaxy.threads : default_threads();
+	vector<Search> workspaces;
+	workspaces.reserve(workers);
+	for (int w = 0; w < workers; w++) {
+		workspaces.emplace_back(galaxy, galaxy.queue);
+	}
+	parallel_for(planets, workers, [&](int worker, int origin) {
+		Search& search = workspaces[worker];
+		search.search(galaxy.planets[origin]);
+		set_row(galaxy, origin, search);
+		search.reset();
+	});
+#if defined(GALAXY_STATS)
+	for (Search& search : workspaces) {
+		galaxy.stats.search.merge(search.counters);
+	}
+#endif
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: The matrix has the galaxy's planets and ships and every pair is unreachable
+*/
+void RouteMatrix::start(const Galaxy & galaxy)
+{
+	planets = galaxy.planets.size();
+	padded = (planets + TILE - 1) / TILE * TILE;
+	schedule = fingerprint(galaxy);
+	planet_names.clear();
+	for (Planet* planet : galaxy.planets) {
+		planet_names.push_back(planet->name);
+	}
+	ship_names.clear();
+	for (int id = 0; id < galaxy.fleet.size(); id++) {
+		ship_names.push_back(galaxy.fleet.name(id));
+	}
+	size_t cells = size_t(padded) * padded;
+	arrival.adopt(vector<Time>(cells, MAX_TIME));
+	predecessor.adopt(vector<int>(cells, -1));
+	ship.adopt(vector<Ship_ID>(cells, -1));
+	departure.adopt(vector<Time>(cells, MAX_TIME));
+	file = MappedFile();
+}
+
+/*
+Precondition: None
+Postcondition: Returns the fingerprint
+Mixes in the planet and ship names and every connection, so any schedule update changes it.
+*/
+uint64_t RouteMatrix::fingerprint(const Galaxy & galaxy)
+{
+	uint64_t sum = 0;
+	auto mix = [&](uint64_t value) {
+		sum = (sum ^ value) * 0x9E3779B97F4A7C15ULL;
+		sum ^= sum >> 32;
+	};
+	auto mix_name = [&](const string& name) {
+		for (char c : name) {
+			mix(uint8_t(c));
+		}
+		mix(name.size());
+	};
+	mix(galaxy.planets.size());
+	for (Planet* planet : galaxy.planets) {
+		mix_name(planet->name);
+	}
+	mix(galaxy.fleet.size());
+	for (int id = 0; id < galaxy.fleet.size(); id++) {
+		mix_name(galaxy.fleet.name(id));
+	}
+	const Connections& c = galaxy.connections();
+	mix(c.size());
+	for (int i = 0; i < c.size(); i++) {
+		mix((uint64_t(unsigned(c.source[i])) << 32) | unsigned(c.destination[i]));
+		mix((uint64_t(unsigned(c.departure_time[i])) << 32) | unsigned(c.arrival_time[i]));
+		mix(unsigned(c.id[i]));
+	}
+	return sum;
+}
+
+/*
+Precondition: compute() or load() has been called
+Postcondition: Returns true if the file was written
+*/
+bool RouteMatrix::write(const string & path) const
+{
+	ofstream out(path, ios::binary | ios::trunc);
+	if (!out) {
+		return false;
+	}
+	ArrayWriter writer(out);
+	writer.write_names(planets, [&](int i) { return planet_names[i]; });
+	writer.write_names(ship_names.size(), [&](int i) { return ship_names[i]; });
+	writer.write(&schedule, 1);
+	writer.write(arrival);
+	writer.write(predecessor);
+	writer.write(ship);
+	writer.write(departure);
+	return writer.finish(MAGIC, VERSION);
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the matrix was loaded
+Besides the header and checksum, checks that every matrix covers the padded V x V tiles and
+every planet and ship id is in range, so format() and itinerary() can trust them.
+*/
+bool RouteMatrix::load(const string & path)
+{
+	MappedFile mapped(path);
+	if (!mapped.is_open()) {
+		cerr << "Cannot read route matrix " << path << endl;
+		return false;
+	}
+	BinaryHeader header;
+	const char* payload = open_payload(mapped, MAGIC, VERSION, header, "Route matrix " + path, "route matrix");
+	if (!payload) {
+		return false;
+	}
+	ArrayReader reader(payload, header.payload);
+	const uint32_t* planet_offsets;
+	const uint32_t* ship_offsets;
+	const char* planet_chars;
+	const char* ship_chars;
+	const uint64_t* fingerprint;
+	size_t fingerprint_count;
+	size_t planet_count, planet_chars_size, ship_count, ship_chars_size;
+	bool ok = reader.read(planet_offsets, planet_count) && reader.read(planet_chars, planet_chars_size) &&
+		reader.read(ship_offsets, ship_count) && reader.read(ship_chars, ship_chars_size) &&
+		reader.read(fingerprint, fingerprint_count) && fingerprint_count == 1 &&
+		reader.read(arrival) && reader.read(predecessor) && reader.read(ship) && reader.read(departure) &&
+		reader.arrays == header.arrays && reader.position == header.payload &&
+		names_valid(planet_offsets, planet_count, planet_chars_size) &&
+		names_valid(ship_offsets, ship_count, ship_chars_size);
+	if (ok) {
+		planets = planet_count - 1;
+		padded = (planets + TILE - 1) / TILE * TILE;
+		schedule = *fingerprint;
+		size_t cells = size_t(padded) * padded;
+		ok = arrival.size() == cells && predecessor.size() == cells && ship.size() == cells && departure.size() == cells;
+		for (size_t i = 0; ok && i < cells; i++) {
+			ok = predecessor[i] >= -1 && predecessor[i] < planets && ship[i] >= -1 && (ship[i] < 0 || size_t(ship[i]) < ship_count - 1);
+		}
+	}
+	if (!ok) {
+		cerr << "Route matrix " << path << " is corrupt (inconsistent arrays)" << endl;
+		planets = 0;
+		return false;
+	}
+	planet_names.clear();
+	for (size_t i = 0; i + 1 < planet_count; i++) {
+		planet_names.push_back(string(planet_chars + planet_offsets[i], planet_offsets[i + 1] - planet_offsets[i]));
+	}
+	ship_names.clear();
+	for (size_t i = 0; i + 1 < ship_count; i++) {
+		ship_names.push_back(string(ship_chars + ship_offsets[i], ship_offsets[i + 1] - ship_offsets[i]));
+	}
+	file = move(mapped);
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: Returns the furthest planet
+*/
+int RouteMatrix::furthest(int origin) const
+{
+	int furthest = origin;
+	for (int destination = 0; destination < planets; destination++) {
+		Time time = arrival[cell(origin, destination)];
+		if (time != MAX_TIME && time >= arrival[cell(origin, furthest)]) {
+			furthest = destination;
+		}
+	}
+	return furthest;
+}
+
+/*
+Precondition: None
+Postcondition: Returns the stops
+Walks the predecessors back from the destination. A walk longer than the number of planets 
+can only come from a corrupt file and is cut short. 
+*/
+const vector<int>& RouteMatrix::stops(int origin, int destination) const
+{
+	thread_local vector<int> walk;
+	walk.clear();
+	if (arrival[cell(origin, destination)] == MAX_TIME) {
+		return walk;
+	}
+	for (int stop = destination; stop >= 0 && stop != origin && int(walk.size()) < planets; stop = predecessor[cell(origin, stop)]) {
+		walk.push_back(stop);
+	}
+	return walk;
+}
+
+/*
+Precondition: The matrix matches() the galaxy
+Postcondition: Returns true and fills the itinerary if the destination can be reached
+Like Search::make_itinerary() after Search::search(), the itinerary runs from the destination 
+back to the origin, which is reached at hour 0 by the leg Leg(-1, 0, 0). 
+*/
+bool RouteMatrix::itinerary(const Galaxy & galaxy, int origin, int destination, Itinerary & schedule) const
+{
+	schedule.origin = galaxy.planets[origin];
+	schedule.destinations.clear();
+	schedule.legs.clear();
+	if (arrival[cell(origin, destination)] == MAX_TIME) {
+		return false;
+	}
+	for (int stop : stops(origin, destination)) {
+		size_t i = cell(origin, stop);
+		schedule.destinations.push_back(galaxy.planets[stop]);
+		schedule.legs.push_back(Leg(ship[i], departure[i], arrival[i]));
+	}
+	schedule.destinations.push_back(galaxy.planets[origin]);
+	schedule.legs.push_back(Leg(-1, 0, 0));
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: None
+Writes the legs from the origin on. 
+*/
+void RouteMatrix::format(int origin, int destination, string & text) const
+{
+	if (origin == destination) {
+		return;
+	}
+	const vector<int>& route = stops(origin, destination);
+	char number[16];
+	for (int k = route.size() - 1; k >= 0; k--) {
+		size_t i = cell(origin, route[k]);
+		if (predecessor[i] < 0 || ship[i] < 0) {
+			return;
+		}
+		text += ship_names[ship[i]];
+		text += '\t';
+		text += planet_names[predecessor[i]];
+		text += '\t';
+		text.append(number, to_chars(number, number + sizeof(number), departure[i]).ptr);
+		text += '\t';
+		text += planet_names[route[k]];
+		text += '\t';
+		text.append(number, to_chars(number, number + sizeof(number), arrival[i]).ptr);
+		text += '\n';
+	}
+}
+
+/*
+Precondition: None
+Postcondition: None
+*/
+void RouteMatrix::print(ostream & out) const
+{
+	string text;
+	for (int origin = 0; origin < planets; origin++) {
+		for (int destination = 0; destination < planets; destination++) {
+			if (destination != origin) {
+				format(origin, destination, text);
+				text += '\n';
+			}
+		}
+		out.write(text.data(), text.size());
+		text.clear();
+	}
+}
@@ -0,0 +1,331 @@
+#include "server.h"
+#include "transfer_patterns.h"
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+volatile sig_atomic_t QueryServer::stopping = 0;
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns the exit status
+Waits for input only while no complete line is left over from the last batch. Answers go out
+right after each batch; what a socket does not take at once is sent as it drains.
+*/
+int QueryServer::serve(const string & path)
+{
+	signal(SIGPIPE, SIG_IGN); //A client that went away is noticed when writing to it fails.
+	int listener = -1;
+	if (path == "-") {
+		clients.push_back(Client{ STDIN_FILENO, STDOUT_FILENO, false, string(), string() });
+	}
+	else {
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path)) {
+			cerr << "Socket path is too long: " << path << endl;
+			return EXIT_FAILURE;
+		}
+		memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		unlink(path.c_str());
+		listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+			listen(listener, SOMAXCONN) != 0) {
+			cerr << "Cannot listen on " << path << endl;
+			if (listener >= 0) {
+				close(listener);
+			}
+			return EXIT_FAILURE;
+		}
+		signal(SIGINT, stop);
+		signal(SIGTERM, stop);
+	}
+	int workers = galaxy.threads > 0 ? galaxy.threads : default_threads();
+	for (int w = 0; w < workers; w++) {
+		switch (galaxy.engine) {
+		case CONNECTION_SCAN: scan.emplace_back(galaxy); break;
+		case RAPTOR: raptor.emplace_back(galaxy); break;
+		default: dijkstra.emplace_back(galaxy, galaxy.queue); break;
+		}
+	}
+
+	started = Clock::now();
+	vector<pollfd> events;
+	vector<Request> batch;
+	char chunk[1 << 16];
+	while (!stopping && (listener >= 0 || !clients.empty())) {
+		bool waiting = false;
+		events.clear();
+		events.push_back(pollfd{ listener, POLLIN, 0 });
+		for (Client& client : clients) {
+			waiting = waiting || client.buffer.find('\n') != string::npos || (client.closed && !client.buffer.empty());
+			events.push_back(pollfd{ client.input, short((client.closed ? 0 : POLLIN) | (client.reply.empty() ? 0 : POLLOUT)), 0 });
+		}
+		if (poll(events.data(), events.size(), waiting ? 0 : -1) < 0) {
+			continue; //Interrupted, perhaps to stop.
+		}
+		int connected = clients.size();
+		if (events[0].revents & POLLIN) {
+			int connection = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (connection >= 0) {
+				clients.push_back(Client{ connection, connection, false, string(), string() });
+			}
+		}
+		for (int c = 0; c < connected; c++) {
+			Client& client = clients[c];
+			if (client.closed || !(events[c + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+				continue;
+			}
+			ssize_t count = read(client.input, chunk, sizeof(chunk));
+			if (count > 0) {
+				client.buffer.append(chunk, count);
+			}
+			else if (count == 0 || (errno != EAGAIN && errno != EINTR)) {
+				client.closed = true;
+			}
+		}
+
+		batch.clear();
+		for (unsigned int c = 0; c < clients.size() && batch.size() < MAX_BATCH; c++) {
+			take(c, batch);
+		}
+		if (!batch.empty()) {
+			execute(batch);
+			for (Request& request : batch) {
+				clients[request.client].reply += request.answer;
+			}
+		}
+		for (int c = clients.size() - 1; c >= 0; c--) {
+			Client& client = clients[c];
+			send(client);
+			if (client.closed && client.buffer.empty() && client.reply.empty()) {
+				if (client.input != STDIN_FILENO) {
+					close(client.input);
+				}
+				clients.erase(clients.begin() + c);
+			}
+		}
+	}
+	if (listener >= 0) {
+		for (Client& client : clients) {
+			close(client.input);
+		}
+		close(listener);
+		unlink(path.c_str());
+	}
+	return 0;
+}
+
+/*
+Precondition: None
+Postcondition: None
+The last line of a closed connection needs no line break. Blank lines are skipped.
+*/
+void QueryServer::take(int client, vector<Request>& batch)
+{
+	Client& from = clients[client];
+	size_t start = 0;
+	size_t end;
+	while (batch.size() < MAX_BATCH && start < from.buffer.size()) {
+		end = from.buffer.find('\n', start);
+		if (end == string::npos && !from.closed) {
+			break;
+		}
+		end = end == string::npos ? from.buffer.size() : end;
+		string line = from.buffer.substr(start, end - start);
+		start = end + 1;
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (!line.empty()) {
+			batch.push_back(Request{ client, line, -1, -1, 0, string() });
+		}
+	}
+	from.buffer.erase(0, min(start, from.buffer.size()));
+}
+
+/*
+Precondition: None
+Postcondition: Every request of the batch has its answer
+Queries are ordered by origin and departure, so each group of equal ones is a run of the order.
+STATS is answered last, counting the queries of its own batch.
+*/
+void QueryServer::execute(vector<Request>& batch)
+{
+	Clock::time_point begin = Clock::now();
+	vector<int> order;
+	for (unsigned int i = 0; i < batch.size(); i++) {
+		Request& request = batch[i];
+		if (request.line == "STATS") {
+			continue;
+		}
+		vector<string> fields;
+		stringstream in(request.line);
+		string field;
+		while (getline(in, field, '\t')) {
+			fields.push_back(field);
+		}
+		Planet* origin = fields.size() == 3 ? galaxy.find(fields[0]) : nullptr;
+		Planet* destination = fields.size() == 3 ? galaxy.find(fields[1]) : nullptr;
+		const char* last = fields.size() == 3 ? fields[2].data() + fields[2].size() : nullptr;
+		if (!origin || !destination || from_chars(fields[2].data(), last, request.departure).ptr != last) {
+			request.answer = "ERROR: Invalid query: " + request.line + "\n\n";
+			continue;
+		}
+		request.origin = origin->index;
+		request.destination = destination->index;
+		order.push_back(i);
+	}
+	sort(order.begin(), order.end(), [&](int left, int right) {
+		const Request& a = batch[left];
+		const Request& b = batch[right];
+		return a.origin != b.origin ? a.origin < b.origin : a.departure != b.departure ? a.departure < b.departure : left < right;
+	});
+	vector<int> groups;
+	for (unsigned int k = 0; k < order.size(); k++) {
+		if (k == 0 || batch[order[k]].origin != batch[order[k - 1]].origin || batch[order[k]].departure != batch[order[k - 1]].departure) {
+			groups.push_back(k);
+		}
+	}
+	groups.push_back(order.size());
+
+	if (galaxy.patterns) {
+		int workers = galaxy.threads > 0 ? galaxy.threads : default_threads();
+		parallel_for(order.size(), workers, [&](int, int k) {
+			Request& request = batch[order[k]];
+			Itinerary itinerary;
+			format(request, galaxy.patterns->query(galaxy, request.origin, request.destination, request.departure, itinerary), &itinerary);
+		});
+	}
+	else if (!order.empty()) {
+		switch (galaxy.engine) {
+		case CONNECTION_SCAN: answer(scan, batch, order, groups); break;
+		case RAPTOR: answer(raptor, batch, order, groups); break;
+		default: answer(dijkstra, batch, order, groups); break;
+		}
+	}
+
+	double latency = chrono::duration<double>(Clock::now() - begin).count();
+	for (unsigned int k = 0; k < order.size(); k++, answered++) {
+		if (latencies.size() < LATENCY_WINDOW) {
+			latencies.push_back(latency);
+		}
+		else {
+			latencies[answered % LATENCY_WINDOW] = latency;
+		}
+	}
+	for (Request& request : batch) {
+		if (request.line == "STATS") {
+			request.answer = stats();
+		}
+	}
+}
+
+/*
+Precondition: One workspace per thread
+Postcondition: The queries have their answers
+A group of one query stops searching at its destination; a larger group searches to every planet
+once and reads off each destination.
+*/
+template<typename Workspace>
+void QueryServer::answer(vector<Workspace>& workspaces, vector<Request>& batch, const vector<int>& order,
+	const vector<int>& groups)
+{
+	parallel_for(groups.size() - 1, workspaces.size(), [&](int worker, int g) {
+		Workspace& search = workspaces[worker];
+		Itinerary itinerary;
+		Request& first = batch[order[groups[g]]];
+		Planet* origin = galaxy.planets[first.origin];
+		if (groups[g + 1] - groups[g] == 1) {
+			Planet* destination = galaxy.planets[first.destination];
+			Time arrival = search.query(origin, destination, first.departure);
+			if (arrival != MAX_TIME) {
+				search.make_itinerary(destination, itinerary);
+			}
+			format(first, arrival, &itinerary);
+		}
+		else {
+			search.search(origin, first.departure);
+			for (int k = groups[g]; k < groups[g + 1]; k++) {
+				Request& request = batch[order[k]];
+				Planet* destination = galaxy.planets[request.destination];
+				Time arrival = search.arrival_time(destination);
+				if (arrival != MAX_TIME) {
+					search.make_itinerary(destination, itinerary);
+				}
+				format(request, arrival, &itinerary);
+			}
+		}
+		search.reset();
+	});
+#if defined(GALAXY_STATS)
+	for (Workspace& search : workspaces) {
+		galaxy.stats.search.merge(search.counters);
+		search.counters = SearchCounters();
+	}
+#endif
+}
+
+/*
+Precondition: itinerary holds the route to the destination unless arrival is MAX_TIME
+Postcondition: None
+*/
+void QueryServer::format(Request & request, Time arrival, const Itinerary * itinerary) const
+{
+	string& text = request.answer;
+	text = "START: " + galaxy.planets[request.origin]->name + ", END: " + galaxy.planets[request.destination]->name;
+	if (arrival == MAX_TIME) {
+		text += ", UNREACHABLE\n\n";
+		return;
+	}
+	text += ", TIME: " + to_string(arrival) + "\n";
+	itinerary->format(galaxy.fleet, text);
+	text += '\n';
+}
+
+/*
+Precondition: None
+Postcondition: None
+A client that cannot be written to has gone away; what it sent is dropped.
+*/
+void QueryServer::send(Client & client)
+{
+	while (!client.reply.empty()) {
+		ssize_t count = write(client.output, client.reply.data(), client.reply.size());
+		if (count > 0) {
+			client.reply.erase(0, count);
+		}
+		else if (count < 0 && (errno == EAGAIN || errno == EINTR)) {
+			break;
+		}
+		else {
+			client.reply.clear();
+			client.buffer.clear();
+			client.closed = true;
+		}
+	}
+}
+
+/*
+Precondition: None
+Postcondition: Returns the answer to STATS
+*/
+string QueryServer::stats() const
+{
+	vector<double> sorted(latencies);
+	sort(sorted.begin(), sorted.end());
+	auto percentile = [&](double p) { return sorted.empty() ? 0 : sorted[min(sorted.size() - 1, size_t(p * sorted.size()))] * 1e6; };
+	double seconds = chrono::duration<double>(Clock::now() - started).count();
+	ostringstream text;
+	text << "QUERIES: " << answered << ", QPS: " << (seconds > 0 ? answered / seconds : 0) << ", P50_US: " << percentile(0.5)
+		<< ", P99_US: " << percentile(0.99) << "\n\n";
+	return text.str();
+}
@@ -0,0 +1,311 @@
+#include "shard.h"
+#include "output.h"
+#include "route_matrix.h"
+
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+Precondition: None
+Postcondition: Returns the exit status
+Keeps every worker busy until all shards are done. Messages arrive in pieces, so each worker's
+output is buffered until receive() finds whole messages in it.
+*/
+int ShardCoordinator::run()
+{
+	signal(SIGPIPE, SIG_IGN); //A worker that died is noticed when its output ends.
+	for (int p = 0; p < processes; p++) {
+		if (!spawn()) {
+			cerr << "Cannot start a shard worker" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	vector<pollfd> outputs;
+	char chunk[1 << 16];
+	while (planets < 0 || done < int(shards.size())) {
+		if (workers.empty()) {
+			cerr << "No shard worker is left" << endl;
+			return EXIT_FAILURE;
+		}
+		outputs.clear();
+		for (Worker& worker : workers) {
+			outputs.push_back(pollfd{ worker.output, POLLIN, 0 });
+		}
+		if (poll(outputs.data(), outputs.size(), -1) < 0) {
+			continue; //Interrupted.
+		}
+		for (int w = outputs.size() - 1; w >= 0; w--) {
+			if (outputs[w].revents == 0) {
+				continue;
+			}
+			Worker& worker = workers[w];
+			ssize_t count = read(worker.output, chunk, sizeof(chunk));
+			if (count > 0) {
+				worker.buffer.append(chunk, count);
+			}
+			if (count > 0 && receive(worker)) {
+				continue;
+			}
+			bool replace = worker.shard >= 0;
+			cerr << "Shard worker " << worker.pid << " failed";
+			if (replace) {
+				cerr << "; origins " << shards[worker.shard].first << " to " << shards[worker.shard].last - 1 << " go to another worker";
+			}
+			cerr << endl;
+			if (!retire(w, true) || (replace && !spawn())) {
+				return EXIT_FAILURE;
+			}
+		}
+		for (int w = workers.size() - 1; w >= 0; w--) {
+			if (!workers[w].ready || workers[w].shard >= 0 || queue.empty() || assign(workers[w])) {
+				continue;
+			}
+			cerr << "Shard worker " << workers[w].pid << " failed" << endl;
+			if (!retire(w, true) || !spawn()) {
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	while (!workers.empty()) {
+		retire(workers.size() - 1, false);
+	}
+	return print();
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the worker was started
+Every pipe end is closed on exec, so a worker holds only its own pipes and the end of a worker's
+output is seen as soon as it exits.
+*/
+bool ShardCoordinator::spawn()
+{
+	int input[2];
+	int output[2];
+	if (pipe2(input, O_CLOEXEC) != 0) {
+		return false;
+	}
+	if (pipe2(output, O_CLOEXEC) != 0) {
+		close(input[0]);
+		close(input[1]);
+		return false;
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		dup2(input[0], STDIN_FILENO);
+		dup2(output[1], STDOUT_FILENO);
+		vector<char*> arguments;
+		for (string& argument : command) {
+			arguments.push_back(&argument[0]);
+		}
+		arguments.push_back(nullptr);
+		execvp(arguments[0], arguments.data());
+		_exit(127);
+	}
+	close(input[0]);
+	close(output[1]);
+	if (pid < 0) {
+		close(input[1]);
+		close(output[0]);
+		return false;
+	}
+	workers.push_back(Worker{ pid, input[1], output[0], false, -1, string(), vector<Result>() });
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: Returns false if the worker broke the protocol
+A message whose bytes have not all arrived stays in the buffer. The first READY sets the number
+of planets and the shards; every later one must match it.
+*/
+bool ShardCoordinator::receive(Worker & worker)
+{
+	size_t end;
+	while ((end = worker.buffer.find('\n')) != string::npos) {
+		istringstream fields(worker.buffer.substr(0, end));
+		string kind;
+		fields >> kind;
+		if (kind == "READY") {
+			int count;
+			uint64_t fingerprint;
+			if (!(fields >> count >> fingerprint) || count < 0 || worker.ready) {
+				return false;
+			}
+			if (planets < 0) {
+				planets = count;
+				schedule = fingerprint;
+				results.resize(planets);
+				int size = max(1, (planets + processes * SHARDS_PER_WORKER - 1) / (processes * SHARDS_PER_WORKER));
+				for (int first = 0; first < planets; first += size) {
+					queue.push_back(shards.size());
+					shards.push_back(Shard{ first, min(planets, first + size), 0 });
+				}
+			}
+			else if (count != planets || fingerprint != schedule) {
+				cerr << "Shard worker " << worker.pid << " loaded a different schedule" << endl;
+				return false;
+			}
+			worker.ready = true;
+			worker.buffer.erase(0, end + 1);
+		}
+		else if (kind == "ORIGIN") {
+			int origin;
+			Time arrival;
+			size_t text, name;
+			if (!(fields >> origin >> arrival >> text >> name) || worker.shard < 0 ||
+				origin != shards[worker.shard].first + int(worker.results.size())) {
+				return false;
+			}
+			if (worker.buffer.size() - end - 1 < text + name) {
+				return true;
+			}
+			worker.results.push_back(Result{ arrival, worker.buffer.substr(end + 1, text), worker.buffer.substr(end + 1 + text, name) });
+			worker.buffer.erase(0, end + 1 + text + name);
+		}
+		else if (kind == "DONE") {
+			int first, last;
+			if (!(fields >> first >> last) || worker.shard < 0 || first != shards[worker.shard].first ||
+				last != shards[worker.shard].last || int(worker.results.size()) != last - first) {
+				return false;
+			}
+			move(worker.results.begin(), worker.results.end(), results.begin() + first);
+			worker.results.clear();
+			worker.shard = -1;
+			done++;
+			worker.buffer.erase(0, end + 1);
+		}
+		else {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+Precondition: The worker is ready and idle, and a shard is queued
+Postcondition: Returns true if the shard was sent
+*/
+bool ShardCoordinator::assign(Worker & worker)
+{
+	worker.shard = queue.front();
+	queue.pop_front();
+	Shard& shard = shards[worker.shard];
+	shard.attempts++;
+	string request = "SHARD " + to_string(shard.first) + " " + to_string(shard.last) + "\n";
+	return write(worker.input, request.data(), request.size()) == ssize_t(request.size());
+}
+
+/*
+Precondition: None
+Postcondition: Returns false if the worker's shard has failed MAX_ATTEMPTS times
+A worker that is done is asked to exit by closing its input; a failed one is killed.
+*/
+bool ShardCoordinator::retire(int w, bool failed)
+{
+	Worker& worker = workers[w];
+	close(worker.input);
+	if (failed) {
+		kill(worker.pid, SIGKILL);
+	}
+	close(worker.output);
+	waitpid(worker.pid, nullptr, 0);
+	bool retry = true;
+	if (worker.shard >= 0) {
+		const Shard& shard = shards[worker.shard];
+		if (shard.attempts >= MAX_ATTEMPTS) {
+			cerr << "Origins " << shard.first << " to " << shard.last - 1 << " failed " << shard.attempts << " times" << endl;
+			retry = false;
+		}
+		queue.push_front(worker.shard);
+	}
+	workers.erase(workers.begin() + w);
+	return retry;
+}
+
+/*
+Precondition: Every shard is done
+Postcondition: Returns the exit status
+The listing of Galaxy::print(): every origin's itinerary followed by a blank line, up to the first
+origin that cannot reach every planet, and the longest itinerary in sampleRoute.txt.
+*/
+int ShardCoordinator::print()
+{
+	string block;
+	Time highest = 0;
+	int longest = -1;
+	string missing;
+	for (int i = 0; i < planets && missing.empty(); i++) {
+		if (results[i].arrival > highest) {
+			highest = results[i].arrival;
+			longest = i;
+		}
+		block += results[i].text;
+		block += '\n';
+		if (block.size() >= RouteWriter::BLOCK_SIZE) {
+			cout.write(block.data(), block.size());
+			block.clear();
+		}
+		missing = results[i].unreachable;
+	}
+	if (longest >= 0) {
+		ofstream sample("sampleRoute.txt");
+		sample << results[longest].text;
+	}
+	cout.write(block.data(), block.size());
+	cout.flush();
+	if (!missing.empty()) {
+		cerr << "PLANET: " << missing << ", IS UNREACHABLE!" << endl;
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns the exit status
+Each shard is searched on the galaxy's threads and answered in one write.
+*/
+int run_shard_worker(Galaxy & galaxy)
+{
+	int planets = galaxy.planets.size();
+	cout << "READY " << planets << " " << RouteMatrix::fingerprint(galaxy) << endl;
+	string line;
+	string message;
+	string text;
+	while (getline(cin, line)) {
+		istringstream fields(line);
+		string kind;
+		int first, last;
+		if (!(fields >> kind >> first >> last) || kind != "SHARD" || first < 0 || first > last || last > planets) {
+			cerr << "Invalid shard request: " << line << endl;
+			return EXIT_FAILURE;
+		}
+		vector<Itinerary> schedules(last - first);
+		vector<Planet*> unreachable(last - first);
+		galaxy.search(first, last, schedules, unreachable);
+		message.clear();
+		for (int k = 0; k < last - first; k++) {
+			text.clear();
+			schedules[k].format(galaxy.fleet, text);
+			string name = unreachable[k] ? unreachable[k]->name : string();
+			message += "ORIGIN " + to_string(first + k) + " " + to_string(schedules[k].legs[0].arrival_time) + " " +
+				to_string(text.size()) + " " + to_string(name.size()) + "\n";
+			message += text;
+			message += name;
+		}
+		message += "DONE " + to_string(first) + " " + to_string(last) + "\n";
+		cout.write(message.data(), message.size());
+		cout.flush();
+		if (!cout) {
+			return EXIT_FAILURE;
+		}
+	}
+	return 0;
+}
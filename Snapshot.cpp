@@ -0,0 +1,182 @@
+#include "snapshot.h"
+#include "binary_io.h"
+
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[8] = { 'G', 'A', 'L', 'A', 'X', 'Y', 'S', 'N' };
+
+/*
+Precondition: None
+Postcondition: Returns true if offsets is a valid CSR offset array
+It must have count + 1 entries, start at 0, never decrease and end at total.
+*/
+bool offsets_valid(const Column<int>& offsets, size_t count, size_t total)
+{
+	if (offsets.size() != count + 1 || offsets[0] != 0 || size_t(offsets[count]) != total) {
+		return false;
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (offsets[i] > offsets[i + 1]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if every element is in [0, limit)
+*/
+bool indices_valid(const Column<int>& indices, size_t limit)
+{
+	for (int index : indices) {
+		if (index < 0 || size_t(index) >= limit) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the pool's columns agree in length and its ships exist
+*/
+bool pool_valid(const LegPool& pool, size_t ships)
+{
+	return pool.departure_time.size() == pool.id.size() && pool.arrival_time.size() == pool.id.size() &&
+		indices_valid(pool.id, ships);
+}
+
+}  // namespace
+
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Returns true if the snapshot was written
+Writes a placeholder header, streams the arrays while checksumming them, then rewrites the
+header with the final counts. Edges updated since the last freeze still have their old slices 
+in galaxy.compact, so the arrays are then laid out afresh from the updated Edge objects. 
+*/
+bool Snapshot::write(const Galaxy & galaxy, const string & path)
+{
+	ofstream out(path, ios::binary | ios::trunc);
+	if (!out) {
+		return false;
+	}
+	CompactGalaxy updated;
+	if (!galaxy.compact.changed.empty()) {
+		updated = CompactGalaxy(galaxy);
+	}
+	const CompactGalaxy& compact = galaxy.compact.changed.empty() ? galaxy.compact : updated;
+	ArrayWriter writer(out);
+	writer.write_names(galaxy.planets.size(), [&](int i) { return galaxy.planets[i]->name; });
+	writer.write_names(galaxy.fleet.size(), [&](int i) { return galaxy.fleet.name(i); });
+	writer.write(compact.edge_begin);
+	writer.write(compact.edge_destination);
+	writer.write(compact.leg_begin);
+	writer.write(compact.pareto_begin);
+	for (const LegPool* pool : { &compact.timetable, &compact.pareto }) {
+		writer.write(pool->departure_time);
+		writer.write(pool->arrival_time);
+		writer.write(pool->id);
+	}
+	writer.write(compact.edge_source);
+	writer.write(compact.reverse_begin);
+	writer.write(compact.reverse_edge);
+	writer.write(compact.min_duration);
+	vector<uint64_t> keys;
+	vector<Time> hours;
+	for (auto const &conduit : galaxy.conduits) {
+		keys.push_back(conduit.first);
+		hours.push_back(conduit.second);
+	}
+	writer.write(keys.data(), keys.size());
+	writer.write(hours.data(), hours.size());
+
+	return writer.finish(MAGIC, VERSION);
+}
+
+/*
+Precondition: None
+Postcondition: Returns the galaxy or nullptr
+Maps the file, checks the header and checksum, then points the compact galaxy's columns
+into the mapping and checks that the arrays describe a well-formed graph. Only the planet
+and ship name tables are copied.
+*/
+Galaxy * Snapshot::load(const string & path)
+{
+	MappedFile file(path);
+	if (!file.is_open()) {
+		cerr << "Cannot read snapshot " << path << endl;
+		return nullptr;
+	}
+	BinaryHeader header;
+	const char* payload = open_payload(file, MAGIC, VERSION, header, "Snapshot " + path, "galaxy snapshot");
+	if (!payload) {
+		return nullptr;
+	}
+
+	Galaxy* galaxy = new Galaxy();
+	CompactGalaxy& compact = galaxy->compact;
+	ArrayReader reader(payload, header.payload);
+	const uint32_t* planet_offsets = nullptr;
+	const uint32_t* ship_offsets = nullptr;
+	const char* planet_chars = nullptr;
+	const char* ship_chars = nullptr;
+	size_t planet_count = 0, planet_chars_size = 0, ship_count = 0, ship_chars_size = 0;
+	bool ok = reader.read(planet_offsets, planet_count) && reader.read(planet_chars, planet_chars_size) &&
+		reader.read(ship_offsets, ship_count) && reader.read(ship_chars, ship_chars_size) &&
+		reader.read(compact.edge_begin) && reader.read(compact.edge_destination) &&
+		reader.read(compact.leg_begin) && reader.read(compact.pareto_begin);
+	for (LegPool* pool : { &compact.timetable, &compact.pareto }) {
+		ok = ok && reader.read(pool->departure_time) && reader.read(pool->arrival_time) && reader.read(pool->id);
+	}
+	const uint64_t* keys;
+	const Time* hours;
+	size_t key_count, hour_count;
+	ok = ok && reader.read(compact.edge_source) && reader.read(compact.reverse_begin) &&
+		reader.read(compact.reverse_edge) && reader.read(compact.min_duration) &&
+		reader.read(keys, key_count) && reader.read(hours, hour_count) && key_count == hour_count &&
+		reader.arrays == header.arrays && reader.position == header.payload;
+
+	ok = ok && names_valid(planet_offsets, planet_count, planet_chars_size) &&
+		names_valid(ship_offsets, ship_count, ship_chars_size);
+	if (ok) {
+		size_t planets = planet_count - 1;
+		size_t ships = ship_count - 1;
+		size_t edges = compact.edge_destination.size();
+		ok = offsets_valid(compact.edge_begin, planets, edges) && indices_valid(compact.edge_destination, planets) &&
+			offsets_valid(compact.leg_begin, edges, compact.timetable.id.size()) &&
+			offsets_valid(compact.pareto_begin, edges, compact.pareto.id.size()) &&
+			pool_valid(compact.timetable, ships) && pool_valid(compact.pareto, ships) &&
+			compact.edge_source.size() == edges && indices_valid(compact.edge_source, planets) &&
+			offsets_valid(compact.reverse_begin, planets, edges) &&
+			compact.reverse_edge.size() == edges && indices_valid(compact.reverse_edge, edges) &&
+			compact.min_duration.size() == edges;
+		for (size_t i = 0; ok && i < key_count; i++) {
+			ok = (keys[i] >> 32) < planets && (keys[i] & 0xffffffff) < planets && hours[i] >= 0;
+		}
+	}
+	if (!ok) {
+		cerr << "Snapshot " << path << " is corrupt (inconsistent arrays)" << endl;
+		delete galaxy;
+		return nullptr;
+	}
+
+	for (size_t i = 0; i + 1 < planet_count; i++) {
+		galaxy->add(galaxy->arena.make<Planet>(string(planet_chars + planet_offsets[i], planet_offsets[i + 1] - planet_offsets[i])));
+	}
+	for (size_t i = 0; i + 1 < ship_count; i++) {
+		galaxy->fleet.add(string(ship_chars + ship_offsets[i], ship_offsets[i + 1] - ship_offsets[i]));
+	}
+	for (size_t i = 0; i < key_count; i++) {
+		galaxy->conduits[keys[i]] = hours[i];
+	}
+	galaxy->snapshot = move(file);
+	return galaxy;
+}
@@ -0,0 +1,46 @@
+#include "stats.h"
+
+using namespace std;
+
+/*
+Precondition: None
+Postcondition: Adds the other counters to these
+*/
+void SearchCounters::merge(const SearchCounters & other)
+{
+	searches += other.searches;
+	queue_pushes += other.queue_pushes;
+	queue_reduces += other.queue_reduces;
+	queue_pops += other.queue_pops;
+	stale_pops += other.stale_pops;
+	edges_scanned += other.edges_scanned;
+	legs_examined += other.legs_examined;
+	connections_scanned += other.connections_scanned;
+	rounds += other.rounds;
+	relaxations += other.relaxations;
+}
+
+/*
+Precondition: None
+Postcondition: None
+"enabled" tells whether the program was built with GALAXY_STATS; if not, every figure is zero.
+*/
+void GalaxyStats::write_json(ostream & out) const
+{
+#if defined(GALAXY_STATS)
+	bool enabled = true;
+#else
+	bool enabled = false;
+#endif
+	out << "{\"enabled\":" << (enabled ? "true" : "false")
+		<< ",\"load\":{\"bytes\":" << bytes_parsed << ",\"lines\":" << lines_parsed << ",\"legs\":" << legs_loaded
+		<< ",\"conduits_seconds\":" << conduits_seconds << ",\"routes_seconds\":" << routes_seconds
+		<< ",\"freeze_seconds\":" << freeze_seconds << "}"
+		<< ",\"search\":{\"searches\":" << search.searches << ",\"queue_pushes\":" << search.queue_pushes
+		<< ",\"queue_reduces\":" << search.queue_reduces << ",\"queue_pops\":" << search.queue_pops
+		<< ",\"stale_pops\":" << search.stale_pops << ",\"edges_scanned\":" << search.edges_scanned
+		<< ",\"legs_examined\":" << search.legs_examined << ",\"connections_scanned\":" << search.connections_scanned
+		<< ",\"rounds\":" << search.rounds << ",\"relaxations\":" << search.relaxations
+		<< ",\"seconds\":" << search_seconds << "}"
+		<< ",\"output\":{\"seconds\":" << output_seconds << "}}" << endl;
+}
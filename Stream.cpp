@@ -0,0 +1,296 @@
+#include "stream.h"
+
+using namespace std;
+
+/*
+Precondition: None
+Postcondition: Returns true if both files could be read
+The conduits file is small and is read whole; the routes file is only opened.
+*/
+bool ScheduleStream::open(const string & conduits, const string & routes)
+{
+	ifstream conduitFile(conduits);
+	in.open(routes, ios::binary);
+	routes_path = routes;
+	if (!conduitFile || !in) {
+		cerr << "Cannot read " << (conduitFile ? routes : conduits) << endl;
+		return false;
+	}
+	string text;
+	int number = 0;
+	while (getline(conduitFile, text)) {
+		number++;
+		if (!text.empty() && text.back() == '\r') {
+			text.pop_back();
+		}
+		if (text.empty()) {
+			continue;
+		}
+		string_view start, end;
+		int hours;
+		if (!Reader::parse_conduit(text, start, end, hours)) {
+			cerr << "Invalid input. Line " << number << " of " << conduits << " is not well-formed!" << endl;
+			return false;
+		}
+		int from = planet(start);
+		int to = planet(end);
+		this->conduits[Galaxy::conduit_key(from, to)] = hours;
+		this->conduits[Galaxy::conduit_key(to, from)] = hours;
+	}
+	return true;
+}
+
+/*
+Precondition: open() has succeeded
+Postcondition: Returns false at the end of the file
+A line is left in the buffer if it departs at or after until. Afterwards the legs that left the 
+window are dropped. 
+*/
+bool ScheduleStream::advance(Time until)
+{
+	string_view text;
+	bool more;
+	while ((more = next_line(text))) {
+		string_view leg = text.substr(0, text.size() - (!text.empty() && text.back() == '\r'));
+		string_view ship, departure, destination;
+		Time departure_time, arrival_time;
+		if (Reader::parse_leg(leg, ship, departure, destination, departure_time, arrival_time) && departure_time >= until) {
+			break;
+		}
+		position += text.size() + 1;
+		ingest(text);
+	}
+	while (!legs.empty() && legs.front().leg.departure_time < latest - window) {
+		legs.pop_front();
+	}
+	return more;
+}
+
+/*
+Precondition: None
+Postcondition: Returns true and the line (without its line break) if there is one
+The line stays in the buffer until the caller moves position past it. The last line of the file 
+may lack a line break. 
+*/
+bool ScheduleStream::next_line(string_view & text)
+{
+	size_t end;
+	while ((end = pending.find('\n', position)) == string::npos) {
+		if (!in.is_open()) {
+			if (position >= pending.size()) {
+				return false;
+			}
+			pending += '\n';
+			continue;
+		}
+		pending.erase(0, position);
+		position = 0;
+		size_t kept = pending.size();
+		pending.resize(kept + CHUNK_SIZE);
+		in.read(&pending[kept], CHUNK_SIZE);
+		pending.resize(kept + in.gcount());
+		if (in.gcount() == 0) {
+			in.close();
+		}
+	}
+	text = string_view(pending).substr(position, end - position);
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: None
+Checks the leg against the ship's previous leg as Reader::validate() does, and that the file is
+still in departure order.
+*/
+void ScheduleStream::ingest(string_view text)
+{
+	line++;
+	if (!text.empty() && text.back() == '\r') {
+		text.remove_suffix(1);
+	}
+	if (text.empty() || text[0] == '#') {
+		return;
+	}
+	string_view shipName, departure, destination;
+	Time departure_time, arrival_time;
+	if (!Reader::parse_leg(text, shipName, departure, destination, departure_time, arrival_time)) {
+		cerr << "Invalid input. Line " << line << " of " << routes_path << " is not well-formed!" << endl;
+		invalid_legs++;
+		return;
+	}
+	Connection connection{ planet(departure), planet(destination), Leg(ship(shipName), departure_time, arrival_time) };
+	Ship& previous = fleet[connection.leg.id];
+	string reason;
+	auto travel = conduits.find(Galaxy::conduit_key(connection.source, connection.destination));
+	if (departure_time < latest) {
+		reason = "it departs before the line above it";
+	}
+	else if (previous.planet >= 0 && travel == conduits.end()) {
+		reason = "there is no conduit from " + string(departure) + " to " + string(destination);
+	}
+	else if (previous.planet >= 0 && departure_time + travel->second != arrival_time) {
+		reason = "the flight takes " + to_string(arrival_time - departure_time) + " hours instead of " + to_string(travel->second);
+	}
+	else if (previous.planet >= 0 && previous.arrival + TURNAROUND_TIME > departure_time) {
+		reason = "the ship arrived at hour " + to_string(previous.arrival) + " and needs " + to_string(TURNAROUND_TIME) +
+			" hours before leaving";
+	}
+	else if (previous.planet >= 0 && previous.planet != connection.source) {
+		reason = "the ship is at " + planet_names[previous.planet] + ", not " + string(departure);
+	}
+	if (!reason.empty()) {
+		cerr << "Invalid input. Line " << line << " of " << routes_path << " is not a valid leg: " << reason << endl;
+		invalid_legs++;
+		return;
+	}
+	previous.planet = connection.destination;
+	previous.arrival = arrival_time;
+	latest = departure_time;
+	legs.push_back(connection);
+	for (size_t i = 0; i < active.size();) {
+		if (scan(active[i], connection)) {
+			i++;
+		}
+		else {
+			end(active[i]);
+			active[i] = move(active.back());
+			active.pop_back();
+		}
+	}
+}
+
+/*
+Precondition: None
+Postcondition: Returns the search's id or -1
+*/
+int ScheduleStream::search(const string & origin, const string & destination, Time departure)
+{
+	auto from = planets.find(origin);
+	auto to = planets.find(destination);
+	if (from == planets.end() || to == planets.end()) {
+		cerr << "Unknown planet: " << (from == planets.end() ? origin : destination) << endl;
+		return -1;
+	}
+	if (departure < latest - window) {
+		cerr << "Departure " << departure << " is no longer in the window (hours " << latest - window << " on)" << endl;
+		return -1;
+	}
+	Search search;
+	search.id = results.size();
+	search.origin = from->second;
+	search.destination = to->second;
+	search.departure = departure;
+	search.arrival.assign(planet_names.size(), MAX_TIME);
+	search.arrived_by.resize(planet_names.size());
+	search.aboard.assign(ship_names.size(), -1);
+	search.arrival[search.origin] = departure;
+	results.push_back(Slot{ false, Result{ origin, destination, departure, MAX_TIME, vector<Connection>() } });
+
+	//Catch up on the resident legs leaving from the departure on.
+	auto first = lower_bound(legs.begin(), legs.end(), departure,
+		[](const Connection& connection, Time t) { return connection.leg.departure_time < t; });
+	for (auto connection = first; connection != legs.end(); ++connection) {
+		if (!scan(search, *connection)) {
+			end(search);
+			return search.id;
+		}
+	}
+	active.push_back(move(search));
+	return results.size() - 1;
+}
+
+/*
+Precondition: None
+Postcondition: Returns false once the search has ended
+As ScanSearch::scan(): the traveller boards at the origin, TRANSFER_TIME after reaching a planet,
+or stays aboard. The search ends at the first leg departing no earlier than the arrival at the
+destination, or more than the window after the search's departure.
+*/
+bool ScheduleStream::scan(Search & search, const Connection & connection)
+{
+	const Leg& leg = connection.leg;
+	if (leg.departure_time >= search.arrival[search.destination] || leg.departure_time > search.departure + window) {
+		return false;
+	}
+	if (search.arrival.size() < planet_names.size()) { //Planets and ships first seen after the search started.
+		search.arrival.resize(planet_names.size(), MAX_TIME);
+		search.arrived_by.resize(planet_names.size());
+	}
+	if (search.aboard.size() < ship_names.size()) {
+		search.aboard.resize(ship_names.size(), -1);
+	}
+	int source = connection.source;
+	bool stay = search.aboard[leg.id] == source;
+	bool board = source == search.origin || (search.arrival[source] != MAX_TIME &&
+		search.arrival[source] + TRANSFER_TIME <= leg.departure_time);
+	if (!stay && !board) {
+		search.aboard[leg.id] = -1;
+		return true;
+	}
+	search.aboard[leg.id] = connection.destination;
+	if (leg.arrival_time < search.arrival[connection.destination]) {
+		search.arrival[connection.destination] = leg.arrival_time;
+		search.arrived_by[connection.destination] = connection;
+	}
+	return true;
+}
+
+/*
+Precondition: None
+Postcondition: The search's result is recorded
+The legs arriving first at each planet form a tree of itineraries (see ScanSearch::best_leg()),
+so the itinerary is found by walking back from the destination.
+*/
+void ScheduleStream::end(Search & search)
+{
+	Result& result = results[search.id].result;
+	results[search.id].done = true;
+	result.arrival = search.arrival[search.destination];
+	if (result.arrival == MAX_TIME || search.destination == search.origin) {
+		return;
+	}
+	for (int planet = search.destination; planet != search.origin; planet = search.arrived_by[planet].source) {
+		result.legs.push_back(search.arrived_by[planet]);
+	}
+	reverse(result.legs.begin(), result.legs.end());
+}
+
+/*
+Precondition: None
+Postcondition: No search is in progress
+*/
+void ScheduleStream::finish()
+{
+	for (Search& search : active) {
+		end(search);
+	}
+	active.clear();
+}
+
+/*
+Precondition: None
+Postcondition: Returns the planet's id
+*/
+int ScheduleStream::planet(string_view name)
+{
+	auto found = planets.emplace(string(name), planet_names.size());
+	if (found.second) {
+		planet_names.push_back(string(name));
+	}
+	return found.first->second;
+}
+
+/*
+Precondition: None
+Postcondition: Returns the ship's id
+*/
+Ship_ID ScheduleStream::ship(string_view name)
+{
+	auto found = ships.emplace(string(name), ship_names.size());
+	if (found.second) {
+		ship_names.push_back(string(name));
+		fleet.push_back(Ship{ -1, 0 });
+	}
+	return found.first->second;
+}
@@ -0,0 +1,287 @@
+#include "transfer_patterns.h"
+#include "binary_io.h"
+#include "route_matrix.h"
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[8] = { 'G', 'A', 'L', 'A', 'X', 'Y', 'T', 'P' };
+
+// One journey of a profile: leave at departure, reach the destination
+// at arrival, along pattern node.
+struct Journey {
+	Time departure;
+	Time arrival;
+	int node;
+};
+
+// The patterns to one destination, with node ids local to it, and the
+// runs of every origin in origin order.
+struct Part {
+	vector<int> node_edge;
+	vector<int> node_next;
+	vector<uint32_t> runs;
+	vector<Time> run_until;
+	vector<int> run_pattern;
+};
+
+// Per-thread state of compute().
+struct Workspace {
+	vector<vector<Journey>> profiles;
+	unordered_map<uint64_t, int> nodes;
+};
+
+/*
+Precondition: Every connection departing at or after t has been scanned
+Postcondition: Returns the first journey leaving at or after t, or nullptr
+As ProfileSearch::arrival(): it arrives earliest, since journeys leaving later arrive later.
+*/
+const Journey* first_journey(const vector<Journey>& journeys, Time t)
+{
+	auto journey = upper_bound(journeys.begin(), journeys.end(), t,
+		[](Time time, const Journey& entry) { return entry.departure < time; });
+	return journey == journeys.begin() ? nullptr : &*(journey - 1);
+}
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: The part holds the patterns to the destination
+The scan of ProfileSearch::profile() over the whole schedule. A connection's pattern is its edge
+followed by the pattern of the journey it continues with, so the same pattern is interned once.
+*/
+void scan(const Galaxy & galaxy, int target, Workspace & workspace, Part & part)
+{
+	const Connections& connections = galaxy.connections();
+	vector<vector<Journey>>& profiles = workspace.profiles;
+	profiles.resize(galaxy.planets.size());
+	for (vector<Journey>& journeys : profiles) {
+		journeys.clear();
+	}
+	workspace.nodes.clear();
+	for (int c = connections.size() - 1; c >= 0; c--) {
+		int source = connections.source[c];
+		if (source == target) {
+			continue;
+		}
+		Time arrive = connections.arrival_time[c];
+		int next = -1;
+		if (connections.destination[c] != target) {
+			const Journey* rest = first_journey(profiles[connections.destination[c]], arrive + TRANSFER_TIME);
+			if (!rest) {
+				continue;
+			}
+			arrive = rest->arrival;
+			next = rest->node;
+		}
+		vector<Journey>& journeys = profiles[source];
+		if (!journeys.empty() && journeys.back().arrival <= arrive) {
+			continue;
+		}
+		uint64_t key = (uint64_t(unsigned(connections.edge[c])) << 32) | unsigned(next + 1);
+		auto node = workspace.nodes.emplace(key, part.node_edge.size());
+		if (node.second) {
+			part.node_edge.push_back(connections.edge[c]);
+			part.node_next.push_back(next);
+		}
+		if (!journeys.empty() && journeys.back().departure == connections.departure_time[c]) {
+			journeys.back() = Journey{ connections.departure_time[c], arrive, node.first->second }; //Same departure, earlier arrival.
+		}
+		else {
+			journeys.push_back(Journey{ connections.departure_time[c], arrive, node.first->second });
+		}
+	}
+
+	part.runs.assign(galaxy.planets.size(), 0);
+	for (unsigned int origin = 0; origin < profiles.size(); origin++) {
+		const vector<Journey>& journeys = profiles[origin];
+		for (auto journey = journeys.rbegin(); journey != journeys.rend(); journey++) {
+			if (part.runs[origin] > 0 && part.run_pattern.back() == journey->node) {
+				part.run_until.back() = journey->departure;
+				continue;
+			}
+			part.run_until.push_back(journey->departure);
+			part.run_pattern.push_back(journey->node);
+			part.runs[origin]++;
+		}
+	}
+}
+
+}  // namespace
+
+/*
+Precondition: The galaxy has been frozen
+Postcondition: Holds the patterns of every pair of planets
+Each worker scans for the destinations it takes into a part of its own; the parts are then laid
+end to end in destination order, so node ids are offset by the nodes of the parts before.
+*/
+void TransferPatterns::compute(const Galaxy & galaxy)
+{
+	planets = galaxy.planets.size();
+	edges = galaxy.compact.edge_count();
+	schedule = RouteMatrix::fingerprint(galaxy);
+	int workers = galaxy.threads > 0 ? galaxy.threads : default_threads();
+	vector<Workspace> workspaces(workers);
+	vector<Part> parts(planets);
+	parallel_for(planets, workers, [&](int worker, int destination) {
+		scan(galaxy, destination, workspaces[worker], parts[destination]);
+	});
+
+	vector<uint32_t> begin(1, 0);
+	vector<Time> until;
+	vector<int> pattern;
+	vector<int> edge;
+	vector<int> next;
+	for (Part& part : parts) {
+		int offset = edge.size();
+		for (uint32_t count : part.runs) {
+			begin.push_back(begin.back() + count);
+		}
+		until.insert(until.end(), part.run_until.begin(), part.run_until.end());
+		for (int node : part.run_pattern) {
+			pattern.push_back(node + offset);
+		}
+		edge.insert(edge.end(), part.node_edge.begin(), part.node_edge.end());
+		for (int node : part.node_next) {
+			next.push_back(node < 0 ? -1 : node + offset);
+		}
+		part = Part();
+	}
+	run_begin.adopt(move(begin));
+	run_until.adopt(move(until));
+	run_pattern.adopt(move(pattern));
+	node_edge.adopt(move(edge));
+	node_next.adopt(move(next));
+	file = MappedFile();
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the patterns answer for the galaxy
+*/
+bool TransferPatterns::matches(const Galaxy & galaxy) const
+{
+	return planets == int(galaxy.planets.size()) && edges == galaxy.compact.edge_count() &&
+		schedule == RouteMatrix::fingerprint(galaxy);
+}
+
+/*
+Precondition: None
+Postcondition: Returns the arrival time or MAX_TIME
+Finds the pair's first run that lasts until the departure or later, then walks its pattern.
+*/
+Time TransferPatterns::query(const Galaxy & galaxy, int origin, int destination, Time departure, Itinerary & itinerary) const
+{
+	itinerary.origin = galaxy.planets[origin];
+	itinerary.destinations.clear();
+	itinerary.legs.clear();
+	if (origin != destination) {
+		const Time* first = run_until.data() + run_begin[pair(origin, destination)];
+		const Time* last = run_until.data() + run_begin[pair(origin, destination) + 1];
+		const Time* run = lower_bound(first, last, departure);
+		if (run == last) {
+			return MAX_TIME;
+		}
+		Time ready = departure;
+		for (int node = run_pattern[run - run_until.data()]; node >= 0; node = node_next[node]) {
+			Leg leg = galaxy.compact.earliest_arrival(node_edge[node], ready);
+			if (leg.arrival_time == MAX_TIME) {
+				itinerary.destinations.clear();
+				itinerary.legs.clear();
+				return MAX_TIME;
+			}
+			itinerary.destinations.push_back(galaxy.planets[galaxy.compact.edge_destination[node_edge[node]]]);
+			itinerary.legs.push_back(leg);
+			ready = leg.arrival_time + TRANSFER_TIME;
+		}
+	}
+	reverse(itinerary.destinations.begin(), itinerary.destinations.end());
+	reverse(itinerary.legs.begin(), itinerary.legs.end());
+	itinerary.destinations.push_back(galaxy.planets[origin]);
+	itinerary.legs.push_back(Leg(-1, departure, departure));
+	return itinerary.legs[0].arrival_time;
+}
+
+/*
+Precondition: None
+Postcondition: Returns the bytes held
+*/
+size_t TransferPatterns::bytes() const
+{
+	return run_begin.size() * sizeof(uint32_t) + run_until.size() * sizeof(Time) + run_pattern.size() * sizeof(int) +
+		node_edge.size() * sizeof(int) + node_next.size() * sizeof(int);
+}
+
+/*
+Precondition: compute() or load() has been called
+Postcondition: Returns true if the file was written
+*/
+bool TransferPatterns::write(const string & path) const
+{
+	ofstream out(path, ios::binary | ios::trunc);
+	if (!out) {
+		return false;
+	}
+	ArrayWriter writer(out);
+	uint64_t sizes[3] = { schedule, uint64_t(planets), uint64_t(edges) };
+	writer.write(sizes, 3);
+	writer.write(run_begin);
+	writer.write(run_until);
+	writer.write(run_pattern);
+	writer.write(node_edge);
+	writer.write(node_next);
+	return writer.finish(MAGIC, VERSION);
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the patterns were loaded
+Besides the header and checksum, checks that the runs of every pair are in range and in
+departure order, and that every node names an edge and a node before it, so query() can trust
+them and its walks end.
+*/
+bool TransferPatterns::load(const string & path)
+{
+	MappedFile mapped(path);
+	if (!mapped.is_open()) {
+		cerr << "Cannot read transfer patterns " << path << endl;
+		return false;
+	}
+	BinaryHeader header;
+	const char* payload = open_payload(mapped, MAGIC, VERSION, header, "Transfer patterns " + path, "transfer pattern file");
+	if (!payload) {
+		return false;
+	}
+	ArrayReader reader(payload, header.payload);
+	const uint64_t* sizes;
+	size_t size_count;
+	bool ok = reader.read(sizes, size_count) && size_count == 3 &&
+		reader.read(run_begin) && reader.read(run_until) && reader.read(run_pattern) &&
+		reader.read(node_edge) && reader.read(node_next) &&
+		reader.arrays == header.arrays && reader.position == header.payload;
+	if (ok) {
+		schedule = sizes[0];
+		planets = sizes[1];
+		edges = sizes[2];
+		ok = sizes[1] < (1u << 31) && sizes[2] < (1u << 31) && run_begin.size() == size_t(planets) * planets + 1 &&
+			run_begin[0] == 0 && run_begin[run_begin.size() - 1] == run_until.size() && run_pattern.size() == run_until.size() &&
+			node_next.size() == node_edge.size();
+		for (size_t p = 0; ok && p + 1 < run_begin.size(); p++) {
+			ok = run_begin[p] <= run_begin[p + 1];
+			for (uint32_t r = run_begin[p]; ok && r < run_begin[p + 1]; r++) {
+				ok = (r == run_begin[p] || run_until[r - 1] < run_until[r]) &&
+					run_pattern[r] >= 0 && size_t(run_pattern[r]) < node_edge.size();
+			}
+		}
+		for (size_t n = 0; ok && n < node_edge.size(); n++) {
+			ok = node_edge[n] >= 0 && node_edge[n] < edges && node_next[n] >= -1 && node_next[n] < int(n);
+		}
+	}
+	if (!ok) {
+		cerr << "Transfer patterns " << path << " is corrupt (inconsistent arrays)" << endl;
+		planets = 0;
+		return false;
+	}
+	file = move(mapped);
+	return true;
+}
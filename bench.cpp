@@ -0,0 +1,404 @@
+// bench.cpp
+//
+// Benchmark driver for the routing engine.  Generates a synthetic
+// galaxy (see generator.h) in a work directory and times, separately:
+//
+//   load              Reader::load() of the generated files
+//   single_source     single-source searches from sampled origins
+//   itinerary_output  building and printing the furthest itinerary of
+//                     each sampled origin
+//   queries           Galaxy::query() under skewed traffic: most
+//                     queries leave a few hub planets in a few
+//                     departure windows (with -c, through a tree cache
+//                     of that many trees, whose hit rate and memory
+//                     use follow as a tree_cache line; with -i, from
+//                     transfer patterns computed in a transfer_patterns
+//                     phase, which reports the index size)
+//   all_pairs         Galaxy::search() over every origin (with -a;
+//                     with -B, in batches of that many origins)
+//   updates           random schedule updates (with -u rounds): each
+//                     round cancels, restores or shifts a leg and then
+//                     checks a fixed set of Galaxy::query() answers,
+//                     cached before the update, against fresh searches;
+//                     the phase reports the answers that differ
+//
+// Each phase prints one JSON object per line to cout with its wall
+// time, throughput and, for the per-origin phases, latency percentiles
+// in microseconds, so runs can be compared by a script.  The route
+// output of Galaxy::search() and Itinerary::print() is discarded;
+// sampleRoute.txt is written to the work directory.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "galaxy.h"
+#include "generator.h"
+#include "snapshot.h"
+#include "transfer_patterns.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+	return chrono::duration<double>(Clock::now() - start).count();
+}
+
+//Prints one phase as a JSON object. Latencies (in seconds) are optional.
+static void report(const string& phase, int planets, long long legs, double seconds, double work,
+	const string& unit, vector<double> latencies = vector<double>()) {
+	cout << "{\"phase\":\"" << phase << "\",\"planets\":" << planets << ",\"legs\":" << legs
+		<< ",\"seconds\":" << seconds << ",\"throughput\":" << (seconds > 0 ? work / seconds : 0)
+		<< ",\"unit\":\"" << unit << "\"";
+	if (!latencies.empty()) {
+		sort(latencies.begin(), latencies.end());
+		auto percentile = [&](double p) { return latencies[min(latencies.size() - 1, size_t(p * latencies.size()))] * 1e6; };
+		cout << ",\"count\":" << latencies.size() << ",\"p50_us\":" << percentile(0.5) << ",\"p90_us\":" << percentile(0.9)
+			<< ",\"p99_us\":" << percentile(0.99) << ",\"max_us\":" << latencies.back() * 1e6;
+	}
+	cout << "}" << endl;
+}
+
+//Times one search per sampled origin with a workspace of either engine.
+template<typename Workspace>
+static void benchSearches(Galaxy* galaxy, Workspace& search, const vector<Planet*>& origins, long long legs) {
+	vector<double> latencies;
+	Clock::time_point start = Clock::now();
+	for (Planet* origin : origins) {
+		Clock::time_point begin = Clock::now();
+		search.search(origin);
+		search.reset();
+		latencies.push_back(seconds_since(begin));
+	}
+	report("single_source", galaxy->planets.size(), legs, seconds_since(start), origins.size(), "searches/s", latencies);
+
+	ofstream discard("/dev/null");
+	Itinerary schedule;
+	latencies.clear();
+	start = Clock::now();
+	for (Planet* origin : origins) {
+		Planet* furthest = search.search(origin);
+		Clock::time_point begin = Clock::now();
+		search.make_itinerary(furthest, schedule);
+		schedule.print(galaxy, galaxy->fleet, discard);
+		latencies.push_back(seconds_since(begin));
+		search.reset();
+	}
+	double total = 0;
+	for (double latency : latencies) {
+		total += latency;
+	}
+	report("itinerary_output", galaxy->planets.size(), legs, total, origins.size(), "itineraries/s", latencies);
+}
+
+//Times Galaxy::query() under skewed traffic. Nine queries in ten leave one of a few hubs in 
+//one of a few departure windows; the rest leave any planet at any time. 
+static void benchQueries(Galaxy* galaxy, int queries, long long legs, uint64_t seed) {
+	const int HUBS = 8;
+	const int WINDOWS = 4;
+	uint64_t state = seed;
+	auto below = [&](uint64_t bound) {
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (state >> 33) % bound;
+	};
+	const Connections& connections = galaxy->connections();
+	Time horizon = connections.size() > 0 ? connections.departure_time[connections.size() - 1] / 2 + 1 : 1;
+	int planets = galaxy->planets.size();
+	vector<double> latencies;
+	Itinerary itinerary;
+	Clock::time_point start = Clock::now();
+	for (int q = 0; q < queries; q++) {
+		bool skewed = below(10) != 0;
+		Planet* origin = galaxy->planets[skewed ? below(HUBS) * planets / HUBS : below(planets)];
+		Planet* destination = galaxy->planets[below(planets)];
+		Time departure = skewed ? below(WINDOWS) * horizon / WINDOWS + below(4) : below(horizon);
+		Clock::time_point begin = Clock::now();
+		galaxy->query(origin, destination, departure, itinerary);
+		latencies.push_back(seconds_since(begin));
+	}
+	report("queries", planets, legs, seconds_since(start), queries, "queries/s", latencies);
+	if (galaxy->trees.enabled()) {
+		TreeCache::Usage usage = galaxy->trees.usage();
+		cout << "{\"phase\":\"tree_cache\",\"planets\":" << planets << ",\"legs\":" << legs << ",\"hits\":" << usage.hits
+			<< ",\"misses\":" << usage.misses << ",\"hit_rate\":" << usage.hit_rate() << ",\"evictions\":" << usage.evictions
+			<< ",\"trees\":" << usage.trees << ",\"bytes\":" << usage.bytes << "}" << endl;
+	}
+}
+
+//Applies random updates through the Galaxy API, checking after each one that the answers 
+//query() gives (from its caches where the update left them) match a fresh search. A round 
+//cancels a leg, puts a cancelled leg back or shifts a leg by a few hours; shifts that clash with 
+//the ship's other legs are rejected by the galaxy and counted. Returns the number of wrong 
+//answers. 
+static int benchUpdates(Galaxy* galaxy, int rounds, long long legs, uint64_t seed, const string& snapshot) {
+	const int QUERIES = 32;
+	const Time MAX_DELAY = 8;
+	uint64_t state = seed;
+	auto below = [&](uint64_t bound) {
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (state >> 33) % bound;
+	};
+	struct Flight {
+		string ship;
+		string from;
+		string to;
+		Time departure;
+		Time arrival;
+	};
+	vector<Flight> flights;
+	vector<Flight> cancelled;
+	const Connections& connections = galaxy->connections();
+	for (int i = 0; i < connections.size(); i++) {
+		flights.push_back(Flight{ galaxy->fleet.name(connections.id[i]), galaxy->planets[connections.source[i]]->name,
+			galaxy->planets[connections.destination[i]]->name, connections.departure_time[i], connections.arrival_time[i] });
+	}
+	Time horizon = connections.size() > 0 ? connections.departure_time[connections.size() - 1] / 2 + 1 : 1;
+	int planets = galaxy->planets.size();
+	vector<Planet*> origins, destinations;
+	vector<Time> departures;
+	for (int q = 0; q < QUERIES; q++) {
+		origins.push_back(galaxy->planets[below(planets)]);
+		destinations.push_back(galaxy->planets[below(planets)]);
+		departures.push_back(below(horizon));
+	}
+
+	//The galaxy explains every rejected update on cerr. 
+	ofstream discard("/dev/null");
+	streambuf* errors = cerr.rdbuf(discard.rdbuf());
+	Search reference(*galaxy, galaxy->queue);
+	Itinerary itinerary;
+	int rejected = 0;
+	int wrong = 0;
+	double updating = 0;
+	for (int round = 0; round < rounds && !flights.empty(); round++) {
+		for (int q = 0; q < QUERIES; q++) {
+			galaxy->query(origins[q], destinations[q], departures[q], itinerary);
+		}
+		int kind = below(3);
+		Clock::time_point begin = Clock::now();
+		if (kind == 0 || (kind == 1 && cancelled.empty())) {
+			size_t f = below(flights.size());
+			Flight& flight = flights[f];
+			if (galaxy->cancel_leg(flight.ship, flight.from, flight.departure)) {
+				cancelled.push_back(flight);
+				flight = flights.back();
+				flights.pop_back();
+			}
+			else {
+				rejected++;
+			}
+		}
+		else if (kind == 1) {
+			size_t f = below(cancelled.size());
+			Flight& flight = cancelled[f];
+			if (galaxy->insert_leg(flight.ship, flight.from, flight.to, flight.departure, flight.arrival)) {
+				flights.push_back(flight);
+				flight = cancelled.back();
+				cancelled.pop_back();
+			}
+			else {
+				rejected++;
+			}
+		}
+		else {
+			Flight& flight = flights[below(flights.size())];
+			Time delay = Time(below(2 * MAX_DELAY + 1)) - MAX_DELAY;
+			if (delay != 0 && galaxy->shift_leg(flight.ship, flight.from, flight.departure, delay)) {
+				flight.departure += delay;
+				flight.arrival += delay;
+			}
+			else {
+				rejected++;
+			}
+		}
+		updating += chrono::duration<double>(Clock::now() - begin).count();
+		for (int q = 0; q < QUERIES; q++) {
+			bool reachable = galaxy->query(origins[q], destinations[q], departures[q], itinerary);
+			Time expected = reference.query(origins[q], destinations[q], departures[q]);
+			reference.reset();
+			if ((reachable ? itinerary.legs[0].arrival_time : MAX_TIME) != expected) {
+				wrong++;
+			}
+		}
+	}
+	cerr.rdbuf(errors);
+	report("updates", planets, legs, updating, rounds, "updates/s");
+
+	//A snapshot of the updated galaxy must give the same answers, from every queried origin to 
+	//every planet. 
+	int snapshotWrong = 0;
+	Galaxy* reloaded = Snapshot::write(*galaxy, snapshot) ? Snapshot::load(snapshot) : nullptr;
+	if (!reloaded || reloaded->fleet.size() != galaxy->fleet.size()) {
+		snapshotWrong++;
+	}
+	else {
+		Search loaded(*reloaded, galaxy->queue);
+		for (int q = 0; q < QUERIES; q++) {
+			reference.search(origins[q], departures[q]);
+			loaded.search(reloaded->planets[origins[q]->index], departures[q]);
+			for (int p = 0; p < planets; p++) {
+				if (reference.arrival_time(galaxy->planets[p]) != loaded.arrival_time(reloaded->planets[p])) {
+					snapshotWrong++;
+				}
+			}
+			reference.reset();
+			loaded.reset();
+		}
+	}
+	delete reloaded;
+	cout << "{\"phase\":\"update_check\",\"planets\":" << planets << ",\"legs\":" << legs << ",\"rounds\":" << rounds
+		<< ",\"rejected\":" << rejected << ",\"answers\":" << rounds * QUERIES << ",\"wrong\":" << wrong
+		<< ",\"snapshot_wrong\":" << snapshotWrong << "}" << endl;
+	return wrong + snapshotWrong;
+}
+
+int main(int argc, char* argv[]) {
+	int planets = 1000;
+	long long legs = 0; //0: ten legs per planet.
+	uint64_t seed = 1;
+	string directory = "bench_data"; //Work directory for the generated files and sampleRoute.txt.
+	int samples = 100; //Origins timed in the single-source and itinerary phases.
+	bool allPairs = false;
+	int updates = 0; //Rounds of the updates phase; 0 leaves it out. 
+	int batch = 0; //Origins per scan of the all-pairs phase (see BatchScanSearch). 
+	int trees = 0; //Tree cache capacity for the queries phase; 0 leaves it off. 
+	bool patterns = false; //Answer the queries phase from transfer patterns. 
+	int threads = 0;
+	QueueKind queue = BINARY_HEAP;
+	Engine engine = DIJKSTRA;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:l:s:d:o:at:q:e:c:iB:u:")) != -1) {
+		switch (opt) {
+		case 'n':
+			planets = atoi(optarg);
+			break;
+		case 'l':
+			legs = atoll(optarg);
+			break;
+		case 's':
+			seed = strtoull(optarg, nullptr, 10);
+			break;
+		case 'd':
+			directory = optarg;
+			break;
+		case 'o':
+			samples = atoi(optarg);
+			break;
+		case 'a':
+			allPairs = true;
+			break;
+		case 'B':
+			batch = atoi(optarg);
+			if (batch != 8 && batch != 16 && batch != 32) exit(EXIT_FAILURE);
+			break;
+		case 'u':
+			updates = atoi(optarg);
+			break;
+		case 'c':
+			trees = atoi(optarg);
+			break;
+		case 'i':
+			patterns = true;
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'q':
+			if (string(optarg) == "binary") queue = BINARY_HEAP;
+			else if (string(optarg) == "quaternary") queue = QUATERNARY_HEAP;
+			else if (string(optarg) == "radix") queue = RADIX_HEAP;
+			else exit(EXIT_FAILURE);
+			break;
+		case 'e':
+			if (string(optarg) == "dijkstra") engine = DIJKSTRA;
+			else if (string(optarg) == "csa") engine = CONNECTION_SCAN;
+			else if (string(optarg) == "raptor") engine = RAPTOR;
+			else exit(EXIT_FAILURE);
+			break;
+		default:
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (planets < 2 || samples < 1 || argc != optind) {
+		exit(EXIT_FAILURE);
+	}
+	if (legs == 0) {
+		legs = 10LL * planets;
+	}
+	if ((mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) || chdir(directory.c_str()) != 0) {
+		cerr << "Cannot use work directory " << directory << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	Clock::time_point start = Clock::now();
+	Generator generator(planets, legs, seed);
+	if (!generator.write("conduits.txt", "ship_routes.txt")) {
+		cerr << "Cannot write the generated galaxy to " << directory << endl;
+		exit(EXIT_FAILURE);
+	}
+	legs = generator.legs_written();
+	report("generate", planets, legs, seconds_since(start), legs, "legs/s");
+
+	start = Clock::now();
+	Reader read("conduits.txt", "ship_routes.txt");
+	read.threads = threads;
+	Galaxy* galaxy = read.load();
+	report("load", planets, legs, seconds_since(start), legs, "legs/s");
+	galaxy->threads = threads;
+	galaxy->queue = queue;
+	galaxy->engine = engine;
+
+	//Origins spread evenly over the galaxy.
+	vector<Planet*> origins;
+	for (int i = 0; i < samples; i++) {
+		origins.push_back(galaxy->planets[(long long)i * planets / samples % planets]);
+	}
+	if (engine == CONNECTION_SCAN) {
+		ScanSearch search(*galaxy);
+		benchSearches(galaxy, search, origins, legs);
+	}
+	else if (engine == RAPTOR) {
+		RaptorSearch search(*galaxy);
+		benchSearches(galaxy, search, origins, legs);
+	}
+	else {
+		Search search(*galaxy, queue);
+		benchSearches(galaxy, search, origins, legs);
+	}
+
+	galaxy->trees.configure(trees, TreeCache::BUCKET);
+	if (patterns) {
+		shared_ptr<TransferPatterns> index = make_shared<TransferPatterns>();
+		start = Clock::now();
+		index->compute(*galaxy);
+		double seconds = seconds_since(start);
+		report("transfer_patterns", planets, legs, seconds, planets, "destinations/s");
+		cout << "{\"phase\":\"transfer_pattern_index\",\"planets\":" << planets << ",\"legs\":" << legs << ",\"runs\":" << index->runs()
+			<< ",\"patterns\":" << index->patterns() << ",\"bytes\":" << index->bytes() << "}" << endl;
+		galaxy->patterns = index;
+	}
+	benchQueries(galaxy, 10 * samples, legs, seed);
+
+	if (allPairs) {
+		ofstream discard("/dev/null");
+		streambuf* output = cout.rdbuf(discard.rdbuf());
+		galaxy->highestTime = 0;
+		galaxy->batch = batch;
+		start = Clock::now();
+		galaxy->search();
+		double seconds = seconds_since(start);
+		cout.rdbuf(output);
+		report("all_pairs", planets, legs, seconds, planets, "origins/s");
+	}
+	if (updates > 0 && benchUpdates(galaxy, updates, legs, seed, directory + "/updated.snap") > 0) {
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
@@ -0,0 +1,201 @@
+// binary_io.h
+//
+// Reading and writing the checksummed binary files of the galaxy: the
+// snapshot (see snapshot.h) and the all-pairs route matrix (see
+// route_matrix.h).
+//
+// Layout (native byte order, every array 8-byte aligned):
+//
+//   header   8-byte magic naming the format, version, array count,
+//            payload size, checksum of the payload
+//   payload  for each array: element count, element size, elements,
+//            padding to a multiple of 8 bytes
+//
+// A file is written with a placeholder header that finish() replaces
+// once the payload is complete, and is read by mapping it and pointing
+// Columns straight into the mapping.
+
+#if !defined(BINARY_IO_H)
+#define BINARY_IO_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "galaxy.h"
+#include "mapped_file.h"
+
+struct BinaryHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t arrays;
+	uint64_t payload;
+	uint64_t checksum;
+};
+
+/*
+Precondition: size is a multiple of 8
+Postcondition: Returns the updated checksum
+Mixes the data into the running checksum one 64-bit word at a time.
+*/
+inline uint64_t checksum(uint64_t sum, const char* data, size_t size)
+{
+	for (size_t i = 0; i < size; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		sum = (sum ^ word) * 0x9E3779B97F4A7C15ULL;
+		sum ^= sum >> 32;
+	}
+	return sum;
+}
+
+// Class ArrayWriter appends arrays to a binary file, keeping count of
+// them and of the payload checksum.
+class ArrayWriter {
+public:
+	// Writes the placeholder header.
+	ArrayWriter(std::ofstream& out) : out(out), arrays(0), payload(0), sum(0) {
+		BinaryHeader header = {};
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+
+	template<typename T>
+	void write(const T* data, size_t count) {
+		uint64_t fields[2] = { count, sizeof(T) };
+		record.assign(reinterpret_cast<const char*>(fields), reinterpret_cast<const char*>(fields + 2));
+		record.insert(record.end(), reinterpret_cast<const char*>(data), reinterpret_cast<const char*>(data + count));
+		record.resize((record.size() + 7) / 8 * 8, 0);
+		sum = checksum(sum, record.data(), record.size());
+		out.write(record.data(), record.size());
+		payload += record.size();
+		arrays++;
+	}
+
+	template<typename T>
+	void write(const Column<T>& column) { write(column.data(), column.size()); }
+
+	// write_names(): a table of strings as offsets plus characters.
+	template<typename Names>
+	void write_names(int count, Names name) {
+		std::vector<uint32_t> offsets(1, 0);
+		std::string chars;
+		for (int i = 0; i < count; i++) {
+			chars += name(i);
+			offsets.push_back(chars.size());
+		}
+		write(offsets.data(), offsets.size());
+		write(chars.data(), chars.size());
+	}
+
+	// finish(): rewrites the header with the final counts and closes the
+	// file.  Returns false if anything could not be written.
+	bool finish(const char (&magic)[8], uint32_t version) {
+		BinaryHeader header = {};
+		memcpy(header.magic, magic, sizeof(magic));
+		header.version = version;
+		header.arrays = arrays;
+		header.payload = payload;
+		header.checksum = sum;
+		out.seekp(0);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.close();
+		return !out.fail();
+	}
+
+	std::ofstream& out;
+	uint32_t arrays;
+	uint64_t payload;
+	uint64_t sum;
+private:
+	std::vector<char> record;
+};
+
+// Class ArrayReader walks the arrays of a mapped payload.
+class ArrayReader {
+public:
+	ArrayReader(const char* data, size_t size) : data(data), size(size), position(0), arrays(0) {}
+
+	// read(): the next array, or false if it does not fit the payload or
+	// its elements are not of type T.
+	template<typename T>
+	bool read(const T*& elements, size_t& count) {
+		uint64_t fields[2];
+		if (size - position < sizeof(fields)) {
+			return false;
+		}
+		memcpy(fields, data + position, sizeof(fields));
+		position += sizeof(fields);
+		if (fields[1] != sizeof(T) || fields[0] > (size - position) / sizeof(T)) {
+			return false;
+		}
+		elements = reinterpret_cast<const T*>(data + position);
+		count = fields[0];
+		position += (count * sizeof(T) + 7) / 8 * 8;
+		arrays++;
+		return true;
+	}
+
+	template<typename T>
+	bool read(Column<T>& column) {
+		const T* elements;
+		size_t count;
+		if (!read(elements, count)) {
+			return false;
+		}
+		column.view(elements, count);
+		return true;
+	}
+
+	const char* data;
+	size_t size;
+	size_t position;
+	uint32_t arrays;
+};
+
+/*
+Precondition: None
+Postcondition: Returns the payload, or nullptr if the file is rejected
+Checks the header's magic and version and the payload's size and checksum. name (such as
+"Snapshot galaxy.snap") and kind (such as "galaxy snapshot") word the error printed on cerr.
+*/
+inline const char* open_payload(const MappedFile& file, const char (&magic)[8], uint32_t version,
+	BinaryHeader& header, const std::string& name, const std::string& kind)
+{
+	if (file.size() < sizeof(header)) {
+		std::cerr << name << " is truncated" << std::endl;
+		return nullptr;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version) {
+		std::cerr << name << " is not a version " << version << " " << kind << std::endl;
+		return nullptr;
+	}
+	const char* payload = file.data() + sizeof(header);
+	if (header.payload != file.size() - sizeof(header) || header.payload % 8 != 0 ||
+		checksum(0, payload, header.payload) != header.checksum) {
+		std::cerr << name << " is corrupt (size or checksum mismatch)" << std::endl;
+		return nullptr;
+	}
+	return payload;
+}
+
+/*
+Precondition: None
+Postcondition: Returns true if the name table is consistent
+*/
+inline bool names_valid(const uint32_t* offsets, size_t count, size_t chars)
+{
+	if (count == 0 || offsets[0] != 0 || offsets[count - 1] != chars) {
+		return false;
+	}
+	for (size_t i = 0; i + 1 < count; i++) {
+		if (offsets[i] > offsets[i + 1]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif
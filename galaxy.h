@@ -21,8 +21,19 @@
 #include <vector>
 #include <fstream>
 #include "priority.h"
+#include "parallel.h"
+#include "mapped_file.h"
+#include "stats.h"
+#include "arena.h"
+#include "simd.h"
 #include <map>
 #include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <list>
 
 typedef int Time;
 const Time MAX_TIME = INT_MAX;
@@ -33,12 +44,16 @@ typedef int Ship_ID;
 
 class Planet;
 class Galaxy;
+class RouteWriter;
+class RouteMatrix;
+class TransferPatterns;
 
 // Class Fleet maps internal ship ID to the ship's name .
 class Fleet {
 public:
 	Ship_ID add(const std::string& name) { names.push_back(name);  return names.size() - 1; }
 	const std::string& name(Ship_ID id) const { return names[id]; }
+	int size() const { return names.size(); }
 
 private:
 	std::vector<std::string> names;
@@ -67,6 +82,16 @@ public:
 		return compare(left, right) < 0;
 	}
 
+	// Timetable order: ascending departure time.  Legs leaving at the
+	// same time are ordered latest arrival first so that the dominated
+	// leg is seen last when building an Edge's Pareto view.
+	static bool departs_before(const Leg& left, const Leg& right) {
+		if (left.departure_time != right.departure_time) {
+			return left.departure_time < right.departure_time;
+		}
+		return left.arrival_time > right.arrival_time;
+	}
+
 	Ship_ID id;
 	Time departure_time;
 	Time arrival_time;
@@ -83,6 +108,10 @@ public:
 	~Itinerary(){ legs.clear(); }
 	void print(Galaxy* galaxy, Fleet& fleet, std::ostream& out = std::cout);
 	void printToFile(Fleet& fleet); 
+	// format() appends one line per leg, origin first, to text:
+	// ship, departure planet, departure time, arrival planet and
+	// arrival time, separated by tabs.
+	void format(const Fleet& fleet, std::string& text) const;
 	Planet* origin;
 	std::vector<Planet*> destinations;
 	std::vector<Leg> legs;
@@ -92,146 +121,1230 @@ public:
 // Class Edge is a single edge in the route graph.  It consists of a
 // destination planet and a sequence of legs departing from the origin
 // planet (vertex) to the destination planet.
+//
+// Once every leg has been added the edge is finalized into an
+// immutable timetable ordered by departure time, together with a
+// Pareto-pruned view that drops every leg dominated by a leg leaving
+// no earlier and arriving no later.  Lookups are binary searches, so
+// relaxing an edge no longer depends on the length of its timetable.
 class Edge {
 public:
 	Edge(Planet* destination) : destination(destination) {}
 	void add(Leg& leg) { departures.push_back(leg); }
 
-	// sort(): sort the legs of this edge by arrival time to the
-	// destination planet.
-	void sort();
+	// finalize(): order the legs of this edge by departure time and
+	// build the Pareto-pruned view.  Called once by the Reader after
+	// the schedule has been loaded.
+	void finalize();
+
+	// insert() and remove() change the timetable of a finalized edge,
+	// keeping it ordered and rebuilding the Pareto view.  remove()
+	// returns false if the ship has no leg departing at that time.
+	void insert(const Leg& leg);
+	bool remove(Ship_ID id, Time departure);
+
+	// shortest(): the shortest flight time of any leg, or MAX_TIME.
+	Time shortest() const;
+
+	// earliest_departure(): the first leg departing at or after time t,
+	// or nullptr if no such leg exists.
+	const Leg* earliest_departure(Time t) const;
+
+	// earliest_arrival(): of the legs departing at or after time t, the
+	// one arriving first at the destination planet, or nullptr if no
+	// leg departs that late.
+	const Leg* earliest_arrival(Time t) const;
 
 	void dump(Galaxy* galaxy);
 
 	Planet* destination;
+	// All legs, ordered by departure time after finalize().
 	std::vector<Leg> departures;
+	// Non-dominated legs, ascending in both departure and arrival time.
+	std::vector<Leg> pareto;
+
+private:
+	// prune(): rebuild pareto from the ordered timetable.
+	void prune();
 };
 
 
 //  Class Planet is a node in the route graph.  It contains a sequence
-//  of edges plus additional fields to allow implementation of
-//  Dijkstra's shortest-path algorithm.
+//  of edges to its neighbors.  The state of Dijkstra's algorithm lives
+//  in a Search workspace, indexed by the planet's position in the
+//  Galaxy, so any number of searches may share the same planets.
 class Planet {
 public:
-	Planet(const std::string& name) : name(name), predecessor(nullptr) {}
+	Planet(const std::string& name) : name(name), index(-1) {}
 	void add(Edge* e) { edges.push_back(e); }
 
+	// Debug-friendly output.
+	void dump(Galaxy* galaxy);
+	const std::string name;
+	// Position of this planet in Galaxy::planets.
+	int index;
+private:
+	friend class CompactGalaxy;
+	friend class Galaxy;
+
+	// edges shows the connections between this planet and it's
+	// neighbors.  See class Edge.
+	std::vector<Edge*> edges;
+};
+
+
+// Class Column is a read-only contiguous array that either owns its
+// elements (while a CompactGalaxy is being built) or views elements
+// stored elsewhere, such as a memory-mapped snapshot file.
+template<typename T>
+class Column {
+public:
+	Column() : data_(nullptr), size_(0) {}
+	Column(const Column& other) { *this = other; }
+	Column& operator=(const Column& other) {
+		owned_ = other.owned_;
+		data_ = other.data_ == other.owned_.data() ? owned_.data() : other.data_;
+		size_ = other.size_;
+		return *this;
+	}
+	Column(Column&& other) : data_(nullptr), size_(0) { *this = std::move(other); }
+	Column& operator=(Column&& other) {
+		bool owned = other.data_ == other.owned_.data();
+		owned_ = std::move(other.owned_);
+		data_ = owned ? owned_.data() : other.data_;
+		size_ = other.size_;
+		return *this;
+	}
+
+	void push_back(const T& value) { owned_.push_back(value); adopt(); }
+	// adopt() takes ownership of the elements of a vector.
+	void adopt(std::vector<T>&& values) { owned_ = std::move(values); adopt(); }
+	// view() makes the column refer to size elements at data, which
+	// must outlive it.
+	void view(const T* data, size_t size) { owned_.clear(); data_ = data; size_ = size; }
+
+	const T& operator[](size_t i) const { return data_[i]; }
+	const T* data() const { return data_; }
+	const T* begin() const { return data_; }
+	const T* end() const { return data_ + size_; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+
+private:
+	void adopt() { data_ = owned_.data(); size_ = owned_.size(); }
+
+	std::vector<T> owned_;
+	const T* data_;
+	size_t size_;
+};
+
+
+// Class LegPool is a structure-of-arrays pool of legs: leg i is
+// (id[i], departure_time[i], arrival_time[i]).  Scanning the
+// departure times of a timetable touches only that column.
+class LegPool {
+public:
+	void push_back(const Leg& leg) {
+		id.push_back(leg.id);
+		departure_time.push_back(leg.departure_time);
+		arrival_time.push_back(leg.arrival_time);
+	}
+	Leg operator[](int i) const { return Leg(id[i], departure_time[i], arrival_time[i]); }
+	int size() const { return id.size(); }
+
+	Column<Time> departure_time;
+	Column<Time> arrival_time;
+	Column<Ship_ID> id;
+};
+
+
+// Class CompactGalaxy is the frozen, compressed-sparse-row form of a
+// Galaxy that the search engines run over.  Planets and edges are
+// plain indices: the edges leaving planet p are
+// [edge_begin[p], edge_begin[p + 1]), edge e leads to planet
+// edge_destination[e], and its legs are
+// [leg_begin[e], leg_begin[e + 1]) of the timetable pool (all legs, by
+// departure time) and [pareto_begin[e], pareto_begin[e + 1]) of the
+// pareto pool (see Edge::finalize()).  Everything is stored in a few
+// contiguous arrays, so a relaxation is a linear scan of memory.
+//
+// For backward searches the edges entering planet p are
+// reverse_edge[reverse_begin[p] .. reverse_begin[p + 1]), each leaving
+// planet edge_source[e], and min_duration[e] is the shortest flight
+// time of any leg of edge e.
+//
+// Schedule updates (see Galaxy::insert_leg()) do not rebuild the
+// arrays.  Instead changed[e] points at the Edge whose timetable has
+// replaced that of edge e since the last freeze; lookups through
+// earliest_arrival() and shortest() see the change.
+class CompactGalaxy {
+public:
+	CompactGalaxy() {}
+	// Built from a loaded Galaxy whose edges have been finalized.
+	explicit CompactGalaxy(const Galaxy& galaxy);
+
+	int planet_count() const { return edge_begin.empty() ? 0 : edge_begin.size() - 1; }
+	int edge_count() const { return edge_destination.size(); }
+
+	// earliest_arrival(): the leg of edge e arriving first among those
+	// departing at or after time t.  Its arrival time is MAX_TIME if no
+	// leg departs that late.
+	Leg earliest_arrival(int e, Time t) const {
+		if (!changed.empty() && changed[e]) {
+			const Leg* leg = changed[e]->earliest_arrival(t);
+			return leg ? *leg : Leg();
+		}
+		int begin = pareto_begin[e];
+		int count = pareto_begin[e + 1] - begin;
+		int leg = first_at_least(pareto.departure_time.data() + begin, count, t); //See simd.h. 
+		return leg == count ? Leg() : pareto[begin + leg];
+	}
+
+	// pareto_count(): the number of non-dominated legs of edge e.
+	int pareto_count(int e) const {
+		return !changed.empty() && changed[e] ? changed[e]->pareto.size() : pareto_begin[e + 1] - pareto_begin[e];
+	}
+
+	// shortest(): the shortest flight time of any leg of edge e.
+	Time shortest(int e) const {
+		return !changed.empty() && changed[e] ? changed[e]->shortest() : min_duration[e];
+	}
+
+	// find_edge(): the edge from planet from to planet to, or -1.
+	int find_edge(int from, int to) const {
+		for (int e = edge_begin[from]; e < edge_begin[from + 1]; e++) {
+			if (edge_destination[e] == to) {
+				return e;
+			}
+		}
+		return -1;
+	}
+
+	Column<int> edge_begin;
+	Column<int> edge_destination;
+	Column<int> leg_begin;
+	Column<int> pareto_begin;
+	LegPool timetable;
+	LegPool pareto;
+
+	Column<int> edge_source;
+	Column<int> reverse_begin;
+	Column<int> reverse_edge;
+	Column<Time> min_duration;
+
+	// Edges updated since the last freeze, by edge index (empty if none).
+	std::vector<const Edge*> changed;
+};
+
+
+// Class Connections is the schedule as one flat array of connections,
+// the legs together with the planets they fly between, ordered by
+// departure time.  Connection i is leg (id[i], departure_time[i],
+// arrival_time[i]) from planet source[i] to planet destination[i], a
+// leg of compact edge edge[i].  The scan-based engines walk it front to
+// back (or back to front) instead of following edges.
+class Connections {
+public:
+	Connections() {}
+	// Built from galaxy.compact, including its changed edges.
+	explicit Connections(const Galaxy& galaxy);
+
+	int size() const { return id.size(); }
+	// first(): the first connection departing at or after time t.
+	int first(Time t) const {
+		return first_at_least(departure_time.data(), departure_time.size(), t);
+	}
+
+	std::vector<int> source;
+	std::vector<int> destination;
+	std::vector<Time> departure_time;
+	std::vector<Time> arrival_time;
+	std::vector<Ship_ID> id;
+	std::vector<int> edge;
+};
+
+
+// Class Trips is the schedule grouped into trips for RaptorSearch: a
+// trip is a run of one ship's legs, each leaving from where the one
+// before it arrived, and leg i of the array flies from planet source[i]
+// to planet destination[i] as in Connections.  The legs of trip t are
+// [begin[t], begin[t + 1]), in departure order, so following a ship is
+// a linear walk of the arrays.  A ship's route is normally a single
+// trip; it is split where a cancelled leg leaves a gap, or where a leg
+// leaves before the one before it has arrived.
+//
+// The legs leaving planet p are departures[departure_begin[p] ..
+// departure_begin[p + 1]), in departure order, and leg i belongs to
+// trip trip[i].
+class Trips {
+public:
+	Trips() : last_departure(0) {}
+	// Built from the connections of a galaxy of the given size.
+	Trips(const Connections& connections, int planets);
+
+	int size() const { return begin.empty() ? 0 : begin.size() - 1; }
+
+	std::vector<int> begin;
+	std::vector<int> trip;
+	std::vector<int> source;
+	std::vector<int> destination;
+	std::vector<Time> departure_time;
+	std::vector<Time> arrival_time;
+	std::vector<Ship_ID> id;
+	Time last_departure;
+
+	std::vector<int> departure_begin;
+	std::vector<int> departures;
+};
+
+
+// Class Search is the workspace for one run of Dijkstra's algorithm:
+// a label per planet holding its predecessor and best leg, plus the
+// priority queue.  Each thread owns one Search, so origins can be
+// searched concurrently over one Galaxy.  The engine is templated over
+// the queue (see priority.h); the backend is picked at construction.
+// Only planets that have been reached are ever pushed.
+class Search {
+public:
+	// Per-planet state of Dijkstra's algorithm.
+	struct Label {
+		int predecessor;
+		Leg best_leg;
+		bool settled;
+	};
+
+	// The search runs over galaxy.compact, which must have been built
+	// (see Galaxy::freeze()).
+	Search(const Galaxy& galaxy, QueueKind kind = BINARY_HEAP);
+
+	// search() computes the shortest path from the origin to each of the
+	// other planets and returns the furthest planet by travel time.  The
+	// traveller is at the origin at hour 0 and, as after any arrival,
+	// needs TRANSFER_TIME before boarding.  The second form searches for
+	// a traveller ready to board at the origin at the given departure
+	// time, as query() does, to every planet.
+	Planet* search(Planet* origin);
+	Planet* search(Planet* origin, Time departure);
+
+	// query() computes the earliest arrival at the destination for a
+	// traveller ready to board at the origin at the given departure
+	// time, stopping as soon as the destination is settled.  Returns
+	// MAX_TIME if the destination cannot be reached.  With pruned set,
+	// a backward search from the destination over minimum flight times
+	// first computes lower bounds on the remaining travel time; the
+	// forward search then ignores planets that cannot reach the
+	// destination and explores the rest in order of arrival time plus
+	// lower bound (A*).  Bounds are kept in the workspace for its next
+	// query to the same destination, until the schedule changes;
+	// has_bounds() tells whether they are there.  Galaxy::query() picks
+	// an idle workspace holding them when it can (see WorkspacePool).
+	Time query(Planet* origin, Planet* destination, Time departure, bool pruned = false);
+	bool has_bounds(const Planet* destination) const;
+
 	// reset() clears the fields set by Dijkstra's algorithm so the
-	// algorithm may be re-run with a different origin planet.
-	void reset() { predecessor = nullptr; best_leg = Leg(); }
-	void dumpPredecessors();
-	void outputAllRoutes(Planet* destination, Fleet& fleet);
-	// search() computes the shortest path from the Planet to each of the
-	// other planets and returns the furthest planet by travel time.
-	Planet* search(PriorityQueue<Planet, int(*)(Planet*, Planet*)>& queue);
+	// algorithm may be re-run with a different origin planet.  Only
+	// the planets the last search reached are touched.
+	void reset();
 
 	// make_itinerary() builds the itinerary with the earliest arrival
-	// time from this planet to the given destination planet.
+	// time from the origin of the last search() or query() to the
+	// given planet.  The second form fills a caller's itinerary,
+	// reusing its buffers, so rebuilding into the same one allocates
+	// nothing once they are large enough.
 	Itinerary* make_itinerary(Planet* destination);
+	void make_itinerary(Planet* destination, Itinerary& schedule);
 
-	// arrival_time() is the time to arrive at this planet from the
+	// arrival_time() is the time to arrive at the planet from the
 	// origin planet that was used to compute the most recent search().
-	Time arrival_time() const { return best_leg.arrival_time; }
+	Time arrival_time(const Planet* planet) const { return labels[planet->index].best_leg.arrival_time; }
+	// best_leg() is the leg arriving at the planet then, and getPred()
+	// the planet it leaves from.
+	const Leg& best_leg(const Planet* planet) const { return labels[planet->index].best_leg; }
+	Planet* getPred(const Planet* planet) const;
 
-	// Debug-friendly output.
-	void dump(Galaxy* galaxy);
-	Planet* getPred() { return predecessor; }
-	// Functions for priority queue:
-	int get_priority() { return priority; }
-	void set_priority(int new_priority) { priority = new_priority; }
-	static int compare(Planet* left, Planet* right) {
-		return Leg::compare(left->best_leg, right->best_leg);
-	}
-	const std::string name;
+	// unreachable() returns a planet the last search() could not reach,
+	// or nullptr if every planet was reached.
+	Planet* unreachable() const;
+
+	void dumpPredecessors(Planet* destination);
+	void outputAllRoutes(Planet* destination, Fleet& fleet, RouteWriter& out);
+
+	// The queue backend the workspace was built for.
+	QueueKind queue_kind() const { return kind; }
+
+	// Counts of this workspace's searches (see stats.h).
+	SearchCounters counters;
 private:
-	// relax_neighbors(): for each neighboring planet of this planet,
+	// relax_neighbors(): for each neighboring planet of the given planet,
 	// determine if the route to the neighbor via this planet is faster
 	// than the previously-recorded travel time to the neighbor.
-	void relax_neighbors(PriorityQueue<Planet, int(*)(Planet*, Planet*)>& queue);
+	// ready is the earliest time a ship can be boarded there.
+	template<typename Queue>
+	void relax_neighbors(int planet, Time ready, Queue& queue);
+
+	// The algorithm itself, for each queue backend.  Runs from origin
+	// until target (-1 for none) is settled and returns the planet
+	// settled last.
+	template<typename Queue>
+	int dijkstra(Queue& queue, int target);
+	int run(int target);
+
+	// compute_bounds(): backward search filling lower_bound for target.
+	void compute_bounds(int target);
+
+	// label(): the label of a planet, recorded as touched on first use.
+	Label& label(int planet) {
+		if (labels[planet].best_leg.arrival_time == MAX_TIME) {
+			touched.push_back(planet);
+		}
+		return labels[planet];
+	}
+
+	const Galaxy& galaxy;
+	Planet* origin;
+	Time origin_ready;
+	std::vector<Label> labels;
+	// Reused by outputAllRoutes().
+	Itinerary route;
+	std::vector<int> touched;
+
+	// For pruned queries: lower bounds on the time from each planet to
+	// bound_target, or nullptr when the search is not pruned.
+	const Time* potential;
+	int bound_target;
+	unsigned bound_generation;
+	std::vector<Time> lower_bound;
+	std::vector<bool> bound_done;
+	BinaryHeap bound_heap;
+
+	QueueKind kind;
+	BinaryHeap binary_heap;
+	QuaternaryHeap quaternary_heap;
+	RadixHeap radix_heap;
+};
+
+
+// Class ProfileSearch answers profile (range) queries: every useful
+// departure from one planet to another within a window of departure
+// times.  One backward scan of the connections, latest first, keeps for
+// each planet the Pareto set of (departure, arrival at the destination)
+// pairs, so the whole window costs about as much as a single query.
+// Transfers follow Search: a traveller boards the first leg at its
+// departure time and any later leg TRANSFER_TIME after arriving.
+class ProfileSearch {
+public:
+	// One non-dominated journey: leave the origin at departure, reach
+	// the destination at arrival.
+	struct Entry {
+		Time departure;
+		Time arrival;
+	};
+
+	ProfileSearch(const Galaxy& galaxy);
+
+	// profile() returns the journeys from origin to destination leaving
+	// in [from, until] that no other journey beats by leaving no earlier
+	// and arriving no later, in ascending order of departure (and so of
+	// arrival).
+	std::vector<Entry> profile(Planet* origin, Planet* destination, Time from, Time until);
+
+	// Counters of the profiles computed, including the query for the
+	// latest useful arrival (see stats.h).
+	SearchCounters counters;
+
+private:
+	// arrival(): the earliest arrival at the destination boarding at
+	// planet at or after time t, or MAX_TIME.
+	Time arrival(int planet, Time t) const;
+
+	const Galaxy& galaxy;
+	// Finds the latest useful arrival: no journey in the window needs to
+	// arrive later than the earliest arrival leaving at until.
+	Search latest;
+	// Per planet, the Pareto set found so far in descending order of
+	// departure (and so of arrival).
+	std::vector<std::vector<Entry>> profiles;
+};
 
-	// edges shows the connections between this planet and it's
-	// neighbors.  See class Edge.
-	std::vector<Edge*> edges;
 
-	// For Dijkstra's algorithm:
-	Planet* predecessor;
-	Leg best_leg;
-	int priority;
+// Class ScanSearch is the workspace of the Connection Scan Algorithm, an
+// alternative engine to Search with the same queries and itineraries.
+// Instead of a priority queue it makes one pass over the connections
+// (see Galaxy::connections()) in departure order, taking every
+// connection it can board: from the origin, from a planet reached
+// TRANSFER_TIME earlier, or by staying aboard a ship it is already on.
+// Staying aboard needs no transfer; the ship's own TURNAROUND_TIME
+// keeps its legs apart, so with TURNAROUND_TIME >= TRANSFER_TIME both
+// engines find the same arrival times.  The pass touches memory only
+// sequentially, which suits dense schedules.
+class ScanSearch {
+public:
+	ScanSearch(const Galaxy& galaxy);
+
+	// As Search::search(), Search::query() (which is never pruned) and
+	// the functions that read their results.
+	Planet* search(Planet* origin);
+	Planet* search(Planet* origin, Time departure);
+	Time query(Planet* origin, Planet* destination, Time departure);
+	void reset();
+	Itinerary* make_itinerary(Planet* destination);
+	void make_itinerary(Planet* destination, Itinerary& schedule);
+	Time arrival_time(const Planet* planet) const { return arrival[planet->index]; }
+	Planet* unreachable() const;
+	void outputAllRoutes(Planet* destination, Fleet& fleet, RouteWriter& out);
+
+	// best_leg() and getPred() give, as for Search, the connection
+	// arriving first at the planet and the planet it leaves from.  Since
+	// TURNAROUND_TIME >= TRANSFER_TIME the traveller could always have
+	// changed ships there, so these form a tree of valid itineraries.
+	Leg best_leg(const Planet* planet) const;
+	Planet* getPred(const Planet* planet) const;
+
+	SearchCounters counters;
+
+private:
+	// scan(): the pass itself, from origin until target (-1 for none)
+	// cannot be improved.
+	void scan(Time ready, int target);
+	// furthest(): the planet reached last, the highest index among ties.
+	Planet* furthest() const;
+
+	const Galaxy& galaxy;
+	const Connections* connections;
+	Planet* origin;
+	Leg origin_leg;
+	// Per planet: earliest arrival and the connection arriving then (-1
+	// for the origin and planets not reached).
+	std::vector<Time> arrival;
+	std::vector<int> arrived_by;
+	// Per ship: the last connection of the ship taken, or -1 if the
+	// traveller cannot be aboard.
+	std::vector<int> aboard;
+	// Per taken connection: the connection of the same ship taken just
+	// before it, or -1 if it was boarded from its departure planet.
+	std::vector<int> stayed_from;
+	std::vector<int> touched_planets;
+	std::vector<int> touched_ships;
+	// Reused by outputAllRoutes().
+	Itinerary route;
+};
+
+
+// Class BatchScanSearch is ScanSearch::search() from up to 32 origins
+// at once, each in its own lane.  Every planet holds one arrival time
+// and arriving connection per lane, side by side, so one pass over the
+// connections serves the whole batch: a connection is boarded by the
+// lanes whose arrival at its departure planet is TRANSFER_TIME early
+// enough, found with one vector compare (see lanes_below in simd.h),
+// and lowers the arrival of each of them it improves.  The connection
+// array is read once per batch instead of once per origin.
+//
+// A lane is aboard a ship if it took the ship's last connection
+// scanned, so each ship keeps that connection and the mask of lanes
+// that took it, and each connection the one of its ship scanned before
+// it.  That is all make_itinerary() needs to walk back as ScanSearch's
+// does, so every lane gets the itinerary ScanSearch would.
+class BatchScanSearch {
+public:
+	// width is the number of lanes: 8, 16 or 32.
+	BatchScanSearch(const Galaxy& galaxy, int width);
+
+	// search() searches from origins [first, first + count), count at
+	// most width, at hour 0 as ScanSearch::search() does; origin
+	// first + k is lane k.
+	void search(int first, int count);
+	void reset();
+
+	// The results of lane k, as ScanSearch's.
+	Planet* furthest(int k) const;
+	Time arrival_time(int k, const Planet* planet) const { return arrival[size_t(planet->index) * width + k]; }
+	void make_itinerary(int k, Planet* destination, Itinerary& schedule) const;
+	Planet* unreachable(int k) const;
+	Leg best_leg(int k, const Planet* planet) const;
+	Planet* getPred(int k, const Planet* planet) const;
+
+	// A view of one lane with the functions of a single-origin search
+	// that RouteMatrix::set_row() reads.
+	class Lane {
+	public:
+		Lane(const BatchScanSearch& search, int k) : search(search), k(k) {}
+		Time arrival_time(const Planet* planet) const { return search.arrival_time(k, planet); }
+		Leg best_leg(const Planet* planet) const { return search.best_leg(k, planet); }
+		Planet* getPred(const Planet* planet) const { return search.getPred(k, planet); }
+	private:
+		const BatchScanSearch& search;
+		int k;
+	};
+	Lane lane(int k) const { return Lane(*this, k); }
+
+	int size() const { return width; }
+
+	SearchCounters counters;
+
+private:
+	const Galaxy& galaxy;
+	const Connections* connections;
+	int width;
+	int first;
+	int count;
+	// Per planet, width lanes each: earliest arrival and the connection
+	// arriving then (-1 for the origin and planets not reached).
+	std::vector<Time> arrival;
+	std::vector<int> arrived_by;
+	// Per ship: its last connection scanned (-1 for none) and the lanes
+	// that took it.
+	std::vector<int> last_scanned;
+	std::vector<uint32_t> aboard;
+	// Per scanned connection: the connection of the same ship scanned
+	// just before it, or -1.
+	std::vector<int> scanned_before;
+};
+
+
+// Class RaptorSearch is the workspace of RAPTOR (Round-bAsed Public
+// Transit Optimized Router), a third engine with the queries and
+// itineraries of Search.  It runs in rounds over the trips of
+// Galaxy::trips(): round k boards, at every planet improved in round
+// k - 1, the first leg of each trip leaving there that the traveller
+// can catch, and rides each boarded trip on, improving the planets it
+// reaches.  The arrivals after round k are thus the earliest with at
+// most k - 1 transfers (changes of ship).  Staying aboard costs
+// nothing; boarding follows Search (TRANSFER_TIME after arriving), so
+// all three engines find the same arrival times.
+//
+// A trip is ridden only up to where an earlier round boarded it, so
+// every leg is walked at most once per search, in trip order.  Ships
+// sail for the whole schedule, so search() and query() only ride legs
+// departing within a horizon, which grows until it holds the answer.
+// journeys() keeps each round's improvements and returns the Pareto
+// set of itineraries over (arrival time, transfers); it needs the
+// whole schedule, since the itinerary with the fewest transfers may
+// arrive last.
+class RaptorSearch {
+public:
+	// One non-dominated itinerary: it arrives at
+	// itinerary.legs[0].arrival_time after the given number of transfers.
+	struct Journey {
+		int transfers;
+		Itinerary itinerary;
+	};
+
+	RaptorSearch(const Galaxy& galaxy);
+
+	// As ScanSearch.
+	Planet* search(Planet* origin);
+	Planet* search(Planet* origin, Time departure);
+	Time query(Planet* origin, Planet* destination, Time departure);
+	void reset();
+	Itinerary* make_itinerary(Planet* destination);
+	void make_itinerary(Planet* destination, Itinerary& schedule);
+	Time arrival_time(const Planet* planet) const { return arrival[planet->index]; }
+	Planet* unreachable() const;
+	void outputAllRoutes(Planet* destination, Fleet& fleet, RouteWriter& out);
+	Leg best_leg(const Planet* planet) const;
+	Planet* getPred(const Planet* planet) const;
+
+	// journeys() returns, for a traveller ready to leave origin at the
+	// given departure time, the itineraries to destination that no
+	// other beats by arriving no later with no more transfers, fewest
+	// transfers (and so latest arrival) first.  At most max_transfers
+	// transfers are made (no limit if it is negative).
+	std::vector<Journey> journeys(Planet* origin, Planet* destination, Time departure, int max_transfers = -1);
+
+	SearchCounters counters;
+
+	// First horizon of a workspace's searches and queries, in hours
+	// after departure (see run()).
+	static const Time HORIZON = 64;
+
+private:
+	// One improvement of a planet: in round, by riding the trip from leg
+	// board to leg leg.  previous is the planet's improvement before it
+	// (-1 for none).
+	struct Label {
+		int round;
+		int board;
+		int leg;
+		int previous;
+	};
+
+	// run(): the search from origin, for a traveller ready to board at
+	// the given time, riding only legs departing within a horizon that
+	// starts span hours later and doubles until it holds the answer.
+	// explore(): the rounds within the horizon, until target (-1 for
+	// none) cannot be improved or rounds rounds have run (no limit if
+	// negative).
+	void run(Time ready, int target, int rounds, Time span);
+	void explore(int target, int rounds);
+	// clear(): reset() but for the origin.
+	void clear();
+	// ride(): rides a trip from leg from in the given round.
+	void ride(int trip, int from, int round, int target);
+	// furthest(): the planet reached last, the highest index among ties.
+	Planet* furthest() const;
+	// make_journey(): the itinerary of an improvement of a planet,
+	// following each trip back to the improvement it boarded from.
+	void make_journey(int label, Itinerary& schedule) const;
+
+	const Galaxy& galaxy;
+	const Trips* trips;
+	Planet* origin;
+	Leg origin_leg;
+	Time origin_ready;
+	// Per planet: earliest arrival, the leg arriving then (-1 for the
+	// origin and planets not reached) and its latest improvement.
+	std::vector<Time> arrival;
+	std::vector<int> arrived_by;
+	std::vector<int> latest;
+	std::vector<Label> labels;
+	// Planets improved in the last round, and those improved in this one.
+	std::vector<int> marked;
+	std::vector<int> improved;
+	std::vector<char> is_improved;
+	// Per trip: the first leg to board this round (INT_MAX for none),
+	// and the first leg boarded in any round.
+	std::vector<int> first;
+	std::vector<int> boarded;
+	std::vector<int> queued;
+	std::vector<int> touched_planets;
+	std::vector<int> touched_trips;
+	// No leg departing after this can improve an arrival.
+	Time last;
+	// Legs departing from this on are not ridden; span is the first
+	// horizon, in hours after departure, of the next search.
+	Time horizon;
+	Time span;
+	// Reused by outputAllRoutes().
+	Itinerary route;
+};
+
+
+// Class QueryCache keeps the results of Galaxy::query() so repeated
+// queries are answered without a search.  A schedule update drops only
+// the results it can affect: removing or delaying a leg drops the
+// results whose itinerary uses that leg, and adding or advancing a leg
+// drops the results it could improve on, i.e. those departing no later
+// than the leg that arrive after it (or not at all).  Safe to use from
+// several threads; once capacity results are stored it starts over,
+// keeping the dropped entries to store the next results in, so a
+// full cache stores a result without allocating.
+class QueryCache {
+public:
+	explicit QueryCache(size_t capacity = 65536) : capacity(capacity) {}
+
+	// find() returns true if the query has a result, setting reachable
+	// and, if it is, the itinerary.
+	bool find(int origin, int destination, Time departure, Itinerary& itinerary, bool& reachable);
+	// store() records a result; itinerary is nullptr if unreachable.
+	void store(int origin, int destination, Time departure, const Itinerary* itinerary);
+
+	void leg_added(const Leg& leg);
+	void leg_removed(int from, int to, const Leg& leg);
+	void clear();
+
+private:
+	struct Key {
+		int origin;
+		int destination;
+		Time departure;
+		bool operator==(const Key& other) const {
+			return origin == other.origin && destination == other.destination && departure == other.departure;
+		}
+	};
+	struct KeyHash {
+		size_t operator()(const Key& key) const {
+			return (size_t(key.origin) * 0x9E3779B1u ^ size_t(key.destination)) * 0x85EBCA77u ^ size_t(key.departure);
+		}
+	};
+	struct Entry {
+		bool reachable;
+		Itinerary itinerary;
+	};
+
+	typedef std::unordered_map<Key, Entry, KeyHash> Entries;
+
+	std::mutex lock;
+	size_t capacity;
+	Entries entries;
+	// Entries dropped when the cache started over, with their buffers.
+	std::vector<Entries::node_type> spare;
+};
+
+
+// Class TreeCache keeps finished single-source search trees for
+// Galaxy::query(), so the queries from popular origins and departure
+// windows do not search again.  A tree holds the earliest arrival
+// and last leg at every planet for a traveller ready to leave the
+// origin at the start of a departure bucket (departure times are
+// grouped into buckets of bucket hours).  It answers a query leaving
+// later in the bucket whenever its itinerary to the destination leaves
+// the origin no earlier than the query: nothing arrives sooner from a
+// later start.  Otherwise the query is a miss and is searched as usual.
+//
+// At most capacity trees are kept (none if it is 0); the least
+// recently used one is dropped first.  Schedule updates drop the trees
+// they can affect, as for QueryCache.  Safe to use from several
+// threads: trees are immutable and shared, so they are read outside
+// the lock.
+class TreeCache {
+public:
+	// One search tree: for each planet the leg arriving first (Leg() if
+	// it cannot be reached) and the planet it leaves from (-1 for the
+	// origin and planets not reached).
+	struct Tree {
+		// Copies the results of a finished search() of either engine.
+		template<typename Workspace>
+		Tree(const std::vector<Planet*>& planets, int origin, Time departure, const Workspace& search)
+			: origin(origin), departure(departure) {
+			legs.reserve(planets.size());
+			predecessor.reserve(planets.size());
+			for (const Planet* planet : planets) {
+				legs.push_back(search.best_leg(planet));
+				const Planet* pred = search.getPred(planet);
+				predecessor.push_back(pred ? pred->index : -1);
+			}
+		}
+
+		// route() fills the itinerary to the destination for a traveller
+		// leaving at the given departure time, in the form of
+		// Search::make_itinerary(), and sets reachable.  Returns false if
+		// the tree cannot answer for that departure.
+		bool route(const std::vector<Planet*>& planets, int destination, Time departure,
+			Itinerary& itinerary, bool& reachable) const;
+		size_t bytes() const { return sizeof(*this) + legs.capacity() * sizeof(Leg) + predecessor.capacity() * sizeof(int); }
+
+		int origin;
+		Time departure;
+		std::vector<Leg> legs;
+		std::vector<int> predecessor;
+	};
+
+	explicit TreeCache(size_t capacity = 0, Time bucket = BUCKET) : capacity(capacity), bucket(bucket) {}
+
+	// configure() sets the capacity (0 turns the cache off) and bucket
+	// size, dropping every tree.
+	void configure(size_t capacity, Time bucket);
+	bool enabled() const { return capacity > 0; }
+	// start(): the first departure time of the bucket of departure.
+	Time start(Time departure) const { return departure - departure % bucket; }
+
+	// find() returns the tree for the origin and the bucket of
+	// departure, or nullptr; store() adds one, dropping the least
+	// recently used tree when the cache is full.
+	std::shared_ptr<const Tree> find(int origin, Time departure);
+	void store(std::shared_ptr<const Tree> tree);
+	// record() counts a query answered from a tree (hit) or searched.
+	void record(bool hit);
+
+	void leg_added(const Leg& leg);
+	void leg_removed(int from, int to, const Leg& leg);
+	void clear();
+
+	// Usage figures: queries answered and searched, trees dropped to
+	// make room, and trees and bytes held.
+	struct Usage {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		size_t trees;
+		size_t bytes;
+		double hit_rate() const { return hits + misses > 0 ? double(hits) / (hits + misses) : 0; }
+	};
+	Usage usage();
+
+	// Default bucket size in hours.
+	static const Time BUCKET = 6;
+
+private:
+	struct Key {
+		int origin;
+		Time bucket;
+		bool operator==(const Key& other) const { return origin == other.origin && bucket == other.bucket; }
+	};
+	struct KeyHash {
+		size_t operator()(const Key& key) const { return size_t(key.origin) * 0x9E3779B1u ^ size_t(key.bucket); }
+	};
+	// Most recently used first.
+	typedef std::list<std::shared_ptr<const Tree>> Order;
+
+	void erase(Order::iterator tree);
+
+	std::mutex lock;
+	size_t capacity;
+	Time bucket;
+	Order order;
+	std::unordered_map<Key, Order::iterator, KeyHash> entries;
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+	size_t bytes = 0;
+};
+
+
+// Class WorkspacePool keeps the idle workspaces of Galaxy::query()
+// between calls, so a query reuses the labels, queue and buffers of an
+// earlier one instead of building its own: each thread querying at
+// once takes a workspace and gives it back when done.  clear() drops
+// them all, for schedule updates that change what a workspace is sized
+// for.
+template<typename Workspace>
+class WorkspacePool {
+public:
+	// take() returns an idle workspace, or nullptr if there is none: the
+	// one given back last among those prefer() accepts, if any, so state
+	// a workspace keeps between queries is found again.
+	template<typename Prefer>
+	std::unique_ptr<Workspace> take(Prefer prefer) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (idle.empty()) {
+			return nullptr;
+		}
+		int chosen = idle.size() - 1;
+		for (int i = chosen; i >= 0; i--) {
+			if (prefer(*idle[i])) {
+				chosen = i;
+				break;
+			}
+		}
+		std::unique_ptr<Workspace> workspace = std::move(idle[chosen]);
+		idle[chosen] = std::move(idle.back());
+		idle.pop_back();
+		return workspace;
+	}
+	std::unique_ptr<Workspace> take() {
+		return take([](const Workspace&) { return true; });
+	}
+	void give(std::unique_ptr<Workspace> workspace) {
+		std::lock_guard<std::mutex> guard(lock);
+		idle.push_back(std::move(workspace));
+	}
+	void clear() {
+		std::lock_guard<std::mutex> guard(lock);
+		idle.clear();
+	}
+
+private:
+	std::mutex lock;
+	std::vector<std::unique_ptr<Workspace>> idle;
 };
 
 
+// Routing engine used by Galaxy::search() and Galaxy::query().
+enum Engine { DIJKSTRA, CONNECTION_SCAN, RAPTOR };
+
+
 // Class galaxy holds the graph of Old Republic Spaceways' route
 // structure, consisting of a sequence of planets (vertices).  The
 // graph is constructed by adding new planets to the Galaxy object and
 // adding edges to the planet objects.
 class Galaxy {
 public:
-	void add(Planet * planet) { planets.push_back(planet); }
-	void reset() { for (auto planet : planets) { planet->reset(); } }
+	void add(Planet * planet) { planet->index = planets.size(); planets.push_back(planet); }
+	// freeze() builds the compact form of the planets and edges added so
+	// far.  The search engines only see the galaxy as of the last call.
+	void freeze() { compact = CompactGalaxy(*this); }
 	// For each planet, apply Dijkstra's algorithm to find the minimum
 	// travel time to the other planets.  Print the itinerary to the
 	// furthest planet. Terminate with EXIT_FAILURE if the graph is not
 	// strongly connnected (you can't get there from here).  Finally,
 	// print the diameter of the galaxy and its itinerary.
+	//
+	// Origins are distributed over a pool of `threads` threads (0 means
+	// one per hardware thread); output order does not depend on it.
 	void search();
-	void checkAllPlanets(); 
+	void checkAllPlanets(Planet* unreachable); 
+
+	// The searches of search() for the origins [first, last) only, as
+	// used by a worker process (see shard.h): schedules[i - first] gets
+	// the itinerary to the furthest planet from origin i and
+	// unreachable[i - first] a planet it cannot reach, or nullptr.
+	// Nothing is printed.  With keep_routes set, a search of every
+	// origin also keeps its routes.
+	void search(int first, int last, std::vector<Itinerary>& schedules, std::vector<Planet*>& unreachable);
+
+	// cross_check() runs every engine from every planet and reports on
+	// cerr each planet whose arrival times differ.  Returns the number
+	// of differences.
+	int cross_check() const;
+
+	// query() returns the itinerary with the earliest arrival at the
+	// destination for a traveller ready to leave the origin at the
+	// given departure time, or nullptr if the destination cannot be
+	// reached.  See Search::query(); the workspaces are kept between
+	// calls (see WorkspacePool).  The second form fills the caller's
+	// itinerary instead, reusing its buffers, and returns false if the
+	// destination cannot be reached.
+	Itinerary* query(Planet* origin, Planet* destination, Time departure, bool pruned = false) const;
+	bool query(Planet* origin, Planet* destination, Time departure, Itinerary& itinerary, bool pruned = false) const;
+
+	// profile() returns every non-dominated journey from origin to
+	// destination departing in [from, until].  See ProfileSearch.
+	std::vector<ProfileSearch::Entry> profile(Planet* origin, Planet* destination, Time from, Time until) const;
+
+	// connections() returns the schedule as a connection array, built on
+	// first use and again after each schedule update.
+	const Connections& connections() const;
+	// trips() returns it grouped into trips (see RaptorSearch), likewise.
+	const Trips& trips() const;
+
+	// journeys() returns the itineraries from origin to destination with
+	// the fewest transfers for their arrival time.  See
+	// RaptorSearch::journeys().
+	std::vector<RaptorSearch::Journey> journeys(Planet* origin, Planet* destination, Time departure,
+		int max_transfers = -1) const;
+
+	// find() returns the planet with the given name, or nullptr.
+	Planet* find(const std::string& name) const;
+
+	// Schedule updates.  Each one validates the leg the way the Reader
+	// does: the flight must take the conduit's travel time, and the
+	// ship must be at the departure planet with TURNAROUND_TIME to spare
+	// after its previous leg and make its next leg in time.  On success
+	// the edge's timetable is updated in place, the galaxy's generation
+	// is incremented and the affected cached query results are dropped;
+	// otherwise the reason is printed to cerr and false is returned.
+	// Updates must not run concurrently with searches.
+	//
+	// insert_leg() adds a leg (a new ship name adds a ship to the fleet),
+	// cancel_leg() removes the ship's leg leaving the planet at the
+	// given time, and shift_leg() moves that leg by delay hours (which
+	// may be negative).
+	bool insert_leg(const std::string& ship, const std::string& from, const std::string& to,
+		Time departure, Time arrival);
+	bool cancel_leg(const std::string& ship, const std::string& from, Time departure);
+	bool shift_leg(const std::string& ship, const std::string& from, Time departure, Time delay);
+
 	void dump();
 	int highestTime = 0; //used to keep track of the planet with the longest shortest path. 
+	int threads = 0;
+	QueueKind queue = BINARY_HEAP; //Priority queue backend used by search(). 
+	Engine engine = DIJKSTRA;
+	// With batch set to 8, 16 or 32, search() scans from that many
+	// origins at once (see BatchScanSearch) whatever the engine.
+	int batch = 0;
 	Fleet fleet;
 	std::vector<Planet*> planets;
+	// Holds the planets and edges of the galaxy (made with
+	// arena.make<Planet>() and arena.make<Edge>()), which are freed with
+	// it.
+	Arena arena;
+	CompactGalaxy compact;
+	// Snapshot file the compact form views, if the galaxy was loaded
+	// from one (see snapshot.h).  Such a galaxy has no Edge objects until
+	// the first schedule update creates them.
+	MappedFile snapshot;
+
+	// Travel times between pairs of planets, keyed by conduit_key() of
+	// planet indices.  Used to validate schedule updates.
+	std::unordered_map<uint64_t, Time> conduits;
+	static uint64_t conduit_key(int from, int to) { return (uint64_t(unsigned(from)) << 32) | unsigned(to); }
+
+	// Incremented by every schedule update.
+	unsigned generation = 0;
+	// Results of query().
+	mutable QueryCache cache;
+	// Search trees of query(); off until configured.
+	mutable TreeCache trees;
+
+	// With keep_routes set, search() keeps the result of every origin in
+	// routes (see route_matrix.h) instead of only the itinerary to the
+	// furthest planet.  While routes matches the schedule, search()
+	// prints from it without searching again, and earliest_arrival() and
+	// route() answer from it: the earliest arrival from one planet to
+	// another (leaving at hour 0, as search() does) in O(1), and its
+	// itinerary in O(legs).  Schedule updates drop it.
+	bool keep_routes = false;
+	std::shared_ptr<const RouteMatrix> routes;
+	// earliest_arrival() is MAX_TIME, and route() false, if the
+	// destination cannot be reached or no routes are kept.
+	Time earliest_arrival(Planet* origin, Planet* destination) const;
+	bool route(Planet* origin, Planet* destination, Itinerary& itinerary) const;
+
+	// While set, query() answers from these transfer patterns (see
+	// transfer_patterns.h), which must match() the schedule, instead of
+	// searching.  Schedule updates drop them.
+	std::shared_ptr<const TransferPatterns> patterns;
+
+	// Load and search figures, filled in when built with GALAXY_STATS
+	// (see stats.h).  search(), query() and the other searches add
+	// their workspaces' counters, as do RouteMatrix::compute() and
+	// the QueryServer.
+	mutable GalaxyStats stats;
+
+private:
+	// search() over a set of per-thread workspaces of either engine.
+	template<typename Workspace>
+	void search(std::vector<Workspace>& workspaces, int first, int last, std::vector<Itinerary>& schedules,
+		std::vector<Planet*>& unreachable);
+	// search() in batches of origins, one BatchScanSearch per thread.
+	void search_batches(int first, int last, std::vector<Itinerary>& schedules, std::vector<Planet*>& unreachable);
+	// tree_query() answers query() from the tree cache, searching and
+	// storing the tree of the origin and departure bucket first if it
+	// is missing.  Returns false if the tree cannot answer.
+	template<typename Workspace>
+	bool tree_query(Workspace& search, Planet* origin, Planet* destination, Time departure,
+		Itinerary& itinerary, bool& reachable) const;
+	// print() writes the furthest itinerary of each origin found by
+	// search(), stopping after the first origin that could not reach
+	// every planet.
+	void print(std::vector<Itinerary>& schedules, const std::vector<Planet*>& unreachable);
+
+	// One leg of a ship's route, between planet indices.
+	struct Flight {
+		int origin;
+		int destination;
+		Time departure;
+		Time arrival;
+	};
+
+	// thaw() prepares the galaxy for updates: it creates the Edge
+	// objects of a snapshot galaxy and indexes every ship's route.
+	void thaw();
+	// fits() checks a flight against the ship's neighbouring legs,
+	// ignoring the leg at position skip.
+	bool fits(Ship_ID ship, const Flight& flight, int skip);
+	// add_flight() and remove_flight() update the ship's route, the
+	// edge's timetable, the compact form and the cache.
+	void add_flight(Ship_ID ship, const Flight& flight);
+	void remove_flight(Ship_ID ship, int position);
+	// find_flight() returns the position of the ship's leg leaving the
+	// planet at the given time, or -1.
+	int find_flight(Ship_ID ship, int origin, Time departure);
+	// Looks up a ship by name, printing an error if it is unknown.
+	bool find_ship(const std::string& name, Ship_ID& ship);
+
+	bool thawed = false;
+	// Every ship's legs in departure order, and ship name to id.
+	std::vector<std::vector<Flight>> flights;
+	std::unordered_map<std::string, Ship_ID> ships;
+	// Number of non-null entries of compact.changed.
+	int changed_edges = 0;
+
+	mutable std::mutex stats_lock;
+	mutable std::mutex connections_lock;
+	mutable Connections connection_list;
+	mutable bool connections_built = false;
+	mutable std::mutex trips_lock;
+	mutable Trips trip_list;
+	mutable bool trips_built = false;
+	// Workspaces of query(), one per engine (see WorkspacePool).
+	mutable WorkspacePool<Search> dijkstra_workspaces;
+	mutable WorkspacePool<ScanSearch> scan_workspaces;
+	mutable WorkspacePool<RaptorSearch> raptor_workspaces;
 };
 
+// Class Reader loads a Galaxy from a conduits file (travel time between
+// pairs of planets) and a ship routes file (one leg per line).  Both
+// files are memory-mapped and tokenized in place: planet and ship names
+// are interned through hash tables keyed by views into the mappings and
+// times are parsed with std::from_chars, so reading a line copies no
+// strings.
+//
+// The routes file is loaded on `threads` threads.  It is cut into
+// chunks at line boundaries, which are parsed concurrently.  A leg is
+// validated only against the leg on the line before it when both
+// belong to the same run of a ship's legs, so the legs are then
+// validated concurrently as well.  Every line that is not well-formed
+// or not a valid leg is reported with its line number before loading
+// fails.  The valid legs are bucketed by edge with a parallel sort, and
+// the timetables are finalized concurrently, one edge at a time.
 class Reader {
 public:
-	//Saves the time schedule in a map<string, map<string, int>> meant to represent map<startPlanet, map<endPlanet, time>>
-	Reader(std::ifstream& in, std::ifstream& flightSchedule) : inFile(in), route(flightSchedule),
-		previous_ship_id(-1), previous_destination_planet(nullptr), previous_arrival_time(0),
-		ship_id(-1), departure_planet(nullptr), departure_time(0), destination_planet(nullptr),
-		arrival_time(0) { galaxy = new Galaxy(); }
+	Reader(const std::string& conduits, const std::string& routes) : inFile(conduits), route(routes),
+		conduits_path(conduits), routes_path(routes) { galaxy = new Galaxy(); }
 	void timeScheduleDump();
 	Galaxy* load();
+
+	// Threads used to load the routes file (0 means default_threads()).
+	int threads = 0;
+
+	// parse_leg() splits a line of a routes file into its fields, and
+	// parse_conduit() one of a conduits file.  Both return false if the
+	// line is not well-formed.
+	static bool parse_leg(std::string_view line, std::string_view& ship, std::string_view& departure,
+		std::string_view& destination, Time& departure_time, Time& arrival_time);
+	static bool parse_conduit(std::string_view line, std::string_view& start, std::string_view& end, int& hours);
 private:
 	void createTimeSchedule();
 	void createGraph();
 
-	static const int MIN_LAYOVER_TIME = 4;
+	static const int MIN_LAYOVER_TIME = TURNAROUND_TIME;
+	// Smallest chunk of the routes file parsed on its own.
+	static const size_t CHUNK_SIZE = 1 << 16;
 
+	// One well-formed line of the routes file.  Planet names are ids of
+	// intern(), or -1 while a name that is not in the conduits file has
+	// not been interned yet.  continues is set when the line before it
+	// is the same ship's previous leg.
+	struct Record {
+		size_t offset;
+		int line;
+		int departure_name;
+		int destination_name;
+		Time departure_time;
+		Time arrival_time;
+		Ship_ID ship;
+		bool continues;
+	};
 
-	// Read next leg of ship's route
-	bool get_record();
+	// A line that is not well-formed or not a valid leg, and why.
+	struct Problem {
+		int line;
+		std::string message;
+		bool operator<(const Problem& other) const { return line < other.line; }
+	};
 
-	// Verify that that current leg is a valid continuation of the
-	// previous leg or the beginning of the route for another ship.
-	bool validate();
+	// A piece of the routes file, [begin, end), and what parsing it found.
+	// Line numbers are counted from the start of the chunk until the
+	// chunks are joined.
+	struct Chunk {
+		size_t begin;
+		size_t end;
+		int lines;
+		std::vector<Record> records;
+		std::vector<Problem> problems;
+		std::string_view first_ship;
+		std::string_view last_ship;
+	};
 
-	std::ifstream& inFile;
-	std::ifstream& route;
+	// parse() reads the lines of a chunk into records.
+	void parse(Chunk& chunk) const;
 
-	// Data structure holding the travel times between planets.
-	std::map<std::string, std::map<std::string, int>> travelTimes;
+	// validate() checks that a leg is a valid continuation of the ship's
+	// previous leg: it flies along a conduit in the conduit's travel time
+	// from the planet the ship arrived at, at least MIN_LAYOVER_TIME
+	// later.  Returns an empty string or the reason it is not.
+	std::string validate(const Record& previous, const Record& current) const;
 
-	// Input string representing a single leg.
-	std::string currentLeg;
+	// line_at(): the line of the routes file starting at offset.
+	std::string_view line_at(size_t offset) const;
 
-	// Previous leg information for validation.
-	Ship_ID previous_ship_id;
-	Planet* previous_destination_planet;
-	int previous_arrival_time;
+	// intern() returns the id of a planet name, giving new names the
+	// next id; lookup() returns it without adding names, or -1.  planet()
+	// returns the Planet for a name id, creating it the first time the
+	// name is used in a route.
+	int intern(std::string_view name);
+	int lookup(std::string_view name) const;
+	Planet* planet(int name);
 
-	// Current leg information
-	Ship_ID ship_id;
-	Planet* departure_planet;
-	Time departure_time;
-	Planet* destination_planet;
-	Time arrival_time;
+	// Hash key for an ordered pair of ids.
+	static uint64_t pair_key(int first, int second) { return (uint64_t(unsigned(first)) << 32) | unsigned(second); }
 
-	// Planet name to planet object
-	std::map<std::string, Planet*> planets;
+	MappedFile inFile;
+	MappedFile route;
+	std::string conduits_path;
+	std::string routes_path;
+
+	// Travel times between planets, keyed by pair_key() of name ids.
+	std::unordered_map<uint64_t, int> travelTimes;
+
+	// Planet name to name id, and name id to name and planet object.
+	std::unordered_map<std::string_view, int> names;
+	std::vector<std::string_view> name_list;
+	std::vector<Planet*> planets;
 
-	// Planet-name pair to edge object
-	std::map<const Planet*, std::map<const Planet*, Edge*>> edges;
 	// Ship name to id.
-	std::map<std::string, Ship_ID> ships;
+	std::unordered_map<std::string_view, Ship_ID> ships;
 
 	// Route structure under construction.
 	Galaxy* galaxy;
@@ -0,0 +1,57 @@
+// generator.h
+//
+// Synthetic galaxies for benchmarking.
+//
+// Generator writes a conduits file and a ship routes file in the
+// formats the Reader loads, deterministically for a given size and
+// seed.  Every leg passes Reader::validate(): it flies along a conduit
+// in exactly the conduit's travel time, and a ship waits at least
+// TURNAROUND_TIME on the planet it arrived at before its next leg.
+//
+// The conduits form a ring through every planet plus a few random
+// chords per planet.  One ship flies the ring twice starting at hour
+// TRANSFER_TIME, so every planet can reach every other and
+// Galaxy::search() never finds an unreachable planet.  The remaining
+// legs are random walks of other ships over the conduits, starting at
+// random planets and times spread over the ring ship's schedule.
+
+#if !defined(GENERATOR_H)
+#define GENERATOR_H
+
+#include <cstdint>
+#include <string>
+
+class Generator {
+public:
+	// planets must be at least 2.  legs is the total number of legs to
+	// write; the ring ship alone needs 2 * planets of them.
+	Generator(int planets, long long legs, uint64_t seed);
+
+	// write() writes both files.  Returns false if either cannot be
+	// written.
+	bool write(const std::string& conduits, const std::string& routes);
+
+	// Number of legs written by the last write().
+	long long legs_written() const { return written; }
+
+	// Random chords added per planet on top of the ring.
+	static const int CHORDS = 3;
+	// Travel times are in [1, MAX_TRAVEL_TIME].
+	static const int MAX_TRAVEL_TIME = 24;
+	// Legs flown by each random ship.
+	static const int LEGS_PER_SHIP = 100;
+
+private:
+	// next(): the next number of the SplitMix64 sequence; below(): one
+	// in [0, bound).  Used instead of <random> so the output does not
+	// depend on the standard library.
+	uint64_t next();
+	uint64_t below(uint64_t bound) { return next() % bound; }
+
+	int planets;
+	long long legs;
+	uint64_t state;
+	long long written;
+};
+
+#endif
@@ -3,7 +3,17 @@
 #include <string> 
 #include <map>
 #include <utility>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <unistd.h>
 #include "galaxy.h"
+#include "snapshot.h"
+#include "route_matrix.h"
+#include "stream.h"
+#include "transfer_patterns.h"
+#include "shard.h"
+#include "server.h"
 
 using namespace std;
 
@@ -11,18 +21,460 @@ void printStats(string plan1, string plan2, int hours) {
     cout << "START: " << plan1 << ", END: " << plan2 << ", TIME: " << hours << endl;
 }
 
+//Prints every useful departure of a "origin,destination,from,until" range query. 
+void printProfile(Galaxy* galaxy, const string& range) {
+	vector<string> fields;
+	stringstream in(range);
+	string field;
+	while (getline(in, field, ',')) {
+		fields.push_back(field);
+	}
+	Planet* origin = fields.size() == 4 ? galaxy->find(fields[0]) : nullptr;
+	Planet* destination = fields.size() == 4 ? galaxy->find(fields[1]) : nullptr;
+	if (!origin || !destination) {
+		cerr << "Invalid range query: " << range << endl;
+		exit(EXIT_FAILURE);
+	}
+	cout << "START: " << origin->name << ", END: " << destination->name << endl;
+	for (auto const &journey : galaxy->profile(origin, destination, atoi(fields[2].c_str()), atoi(fields[3].c_str()))) {
+		cout << "DEPART: " << journey.departure << ", ARRIVE: " << journey.arrival << endl;
+	}
+}
+
+//Prints the itineraries of an "origin,destination,departure[,max transfers]" query with the fewest 
+//transfers for their arrival time, fewest transfers first. 
+void printJourneys(Galaxy* galaxy, const string& query) {
+	vector<string> fields;
+	stringstream in(query);
+	string field;
+	while (getline(in, field, ',')) {
+		fields.push_back(field);
+	}
+	bool valid = fields.size() == 3 || fields.size() == 4;
+	Planet* origin = valid ? galaxy->find(fields[0]) : nullptr;
+	Planet* destination = valid ? galaxy->find(fields[1]) : nullptr;
+	if (!origin || !destination) {
+		cerr << "Invalid transfer query: " << query << endl;
+		exit(EXIT_FAILURE);
+	}
+	int transfers = fields.size() == 4 ? atoi(fields[3].c_str()) : -1;
+	cout << "START: " << origin->name << ", END: " << destination->name << endl;
+	for (auto const &journey : galaxy->journeys(origin, destination, atoi(fields[2].c_str()), transfers)) {
+		cout << "TRANSFERS: " << journey.transfers << ", ARRIVE: " << journey.itinerary.legs[0].arrival_time << endl;
+		string text;
+		journey.itinerary.format(galaxy->fleet, text);
+		cout << text << endl;
+	}
+}
+
+//Prints the earliest arrival and itinerary of an "origin,destination" lookup from the kept routes. 
+void printLookup(Galaxy* galaxy, const string& pair) {
+	size_t comma = pair.find(',');
+	Planet* origin = comma != string::npos ? galaxy->find(pair.substr(0, comma)) : nullptr;
+	Planet* destination = comma != string::npos ? galaxy->find(pair.substr(comma + 1)) : nullptr;
+	if (!origin || !destination) {
+		cerr << "Invalid lookup: " << pair << endl;
+		exit(EXIT_FAILURE);
+	}
+	Itinerary itinerary;
+	if (!galaxy->route(origin, destination, itinerary)) {
+		cerr << "PLANET: " << destination->name << ", IS UNREACHABLE!" << endl;
+		exit(EXIT_FAILURE);
+	}
+	printStats(origin->name, destination->name, galaxy->earliest_arrival(origin, destination));
+	string text;
+	itinerary.format(galaxy->fleet, text);
+	cout << text;
+}
+
+//Prints the earliest arrival and itinerary of an "origin,destination,departure" query, answered 
+//from the transfer patterns if they are loaded. 
+void printQuery(Galaxy* galaxy, const string& query) {
+	vector<string> fields;
+	stringstream in(query);
+	string field;
+	while (getline(in, field, ',')) {
+		fields.push_back(field);
+	}
+	Planet* origin = fields.size() == 3 ? galaxy->find(fields[0]) : nullptr;
+	Planet* destination = fields.size() == 3 ? galaxy->find(fields[1]) : nullptr;
+	if (!origin || !destination) {
+		cerr << "Invalid query: " << query << endl;
+		exit(EXIT_FAILURE);
+	}
+	Itinerary itinerary;
+	if (!galaxy->query(origin, destination, atoi(fields[2].c_str()), itinerary)) {
+		cerr << "PLANET: " << destination->name << ", IS UNREACHABLE!" << endl;
+		exit(EXIT_FAILURE);
+	}
+	printStats(origin->name, destination->name, itinerary.legs[0].arrival_time);
+	string text;
+	itinerary.format(galaxy->fleet, text);
+	cout << text;
+}
+
+//Applies the schedule updates of a file, one per line, tab-separated: 
+//  INSERT ship from departure to arrival   (the format of a routes line) 
+//  CANCEL ship from departure 
+//  SHIFT ship from departure delay 
+//An update the galaxy rejects is reported with its reason and skipped. Returns the number 
+//rejected. 
+int applyUpdates(Galaxy* galaxy, const string& updates) {
+	ifstream in(updates);
+	if (!in) {
+		cerr << "Cannot read " << updates << endl;
+		exit(EXIT_FAILURE);
+	}
+	int rejected = 0;
+	string line;
+	for (int number = 1; getline(in, line); number++) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line.empty()) {
+			continue;
+		}
+		vector<string> fields;
+		stringstream fieldsIn(line);
+		string field;
+		while (getline(fieldsIn, field, '\t')) {
+			fields.push_back(field);
+		}
+		bool applied = false;
+		if (fields[0] == "INSERT" && fields.size() == 6) {
+			applied = galaxy->insert_leg(fields[1], fields[2], fields[4], atoi(fields[3].c_str()), atoi(fields[5].c_str()));
+		}
+		else if (fields[0] == "CANCEL" && fields.size() == 4) {
+			applied = galaxy->cancel_leg(fields[1], fields[2], atoi(fields[3].c_str()));
+		}
+		else if (fields[0] == "SHIFT" && fields.size() == 5) {
+			applied = galaxy->shift_leg(fields[1], fields[2], atoi(fields[3].c_str()), atoi(fields[4].c_str()));
+		}
+		else {
+			cerr << "Unknown update or wrong number of fields" << endl;
+		}
+		if (!applied) {
+			cerr << "Update on line " << number << " rejected: " << line << endl;
+			rejected++;
+		}
+	}
+	return rejected;
+}
+
+//Writes the load and search figures of the galaxy to the stats file, if one was asked for, and 
+//returns the exit status. Every mode that loads the galaxy returns through here. 
+int finish(Galaxy* galaxy, const string& statsFile, int status) {
+	if (!statsFile.empty()) {
+		ofstream out(statsFile);
+		galaxy->stats.write_json(out);
+	}
+	return status;
+}
+
+//Answers the "origin<tab>destination<tab>departure" queries of a file, in departure order, over a 
+//time-ordered routes file streamed through a window of the given number of hours. 
+int runStream(const string& conduits, const string& routes, const string& queries, Time window) {
+	ScheduleStream stream(window);
+	ifstream in(queries);
+	if (!in) {
+		cerr << "Cannot read " << queries << endl;
+		return EXIT_FAILURE;
+	}
+	if (!stream.open(conduits, routes)) {
+		return EXIT_FAILURE;
+	}
+	vector<int> ids;
+	bool failed = false;
+	string line;
+	while (getline(in, line)) {
+		stringstream fields(line);
+		string origin, destination, departure;
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		if (!getline(fields, origin, '\t') || !getline(fields, destination, '\t') || !getline(fields, departure)) {
+			cerr << "Invalid query: " << line << endl;
+			failed = true;
+			continue;
+		}
+		Time start = atoi(departure.c_str());
+		stream.advance(start);
+		ids.push_back(stream.search(origin, destination, start));
+		failed = failed || ids.back() < 0;
+	}
+	for (Time until = stream.head(); stream.busy() && stream.advance(until); until += window) {
+	}
+	stream.finish();
+	for (int id : ids) {
+		const ScheduleStream::Result* result = id >= 0 ? stream.result(id) : nullptr;
+		if (!result) {
+			continue;
+		}
+		if (result->arrival == MAX_TIME) {
+			cout << "START: " << result->origin << ", END: " << result->destination << ", NOT REACHED WITHIN " << window << " HOURS OF " << result->departure << endl;
+			continue;
+		}
+		printStats(result->origin, result->destination, result->arrival);
+		for (auto const &leg : result->legs) {
+			cout << stream.ship_name(leg.leg.id) << '\t' << stream.planet_name(leg.source) << '\t' << leg.leg.departure_time << '\t'
+				<< stream.planet_name(leg.destination) << '\t' << leg.leg.arrival_time << '\n';
+		}
+		cout << endl;
+	}
+	return failed || stream.invalid() > 0 ? EXIT_FAILURE : 0;
+}
+
 int main(int argc, char* argv[]) {
-        if (argc != 3){
-		exit(EXIT_FAILURE); 
-	}
-	ifstream inFile(argv[1]);
-	ifstream flights(argv[2]);
-	//ifstream inFile("conduits.txt");
-	//ifstream flights("ship_routes.txt");
-	//ifstream flights("asd.txt");
-	Reader read(inFile, flights);
-	Galaxy* starWars = read.load();
+	int threads = 0; //0: one loading and search thread per hardware thread. 
+	QueueKind queue = BINARY_HEAP;
+	Engine engine = DIJKSTRA;
+	int batch = 0; //Search this many origins per scan (see BatchScanSearch); 0 for one at a time. 
+	bool crossCheck = false; //Compare both engines instead of printing routes. 
+	string loadSnapshot; //Read the galaxy from this snapshot instead of the text files. 
+	string writeSnapshot; //Save the loaded galaxy to this snapshot. 
+	string range; //Answer this range query instead of searching every planet. 
+	string transfers; //Answer this transfer query instead of searching every planet. 
+	string statsFile; //Write the load and search figures here as JSON (see stats.h). 
+	string writeMatrix; //Save the all-pairs route matrix here instead of printing routes. 
+	string readMatrix; //Print the itineraries of this route matrix and exit. 
+	bool keepRoutes = false; //Keep every route, saved next to the schedule (see Galaxy::keep_routes). 
+	string lookup; //Answer this lookup from the kept routes instead of printing routes. 
+	Time window = 0; //Stream a time-ordered routes file through a window of this many hours (see stream.h). 
+	string queries; //Queries answered while streaming. 
+	string patternFile; //Transfer patterns, computed and saved here if missing or stale (see transfer_patterns.h). 
+	string pointQuery; //Answer this query instead of printing routes. 
+	string updates; //Apply these schedule updates before anything else (see applyUpdates()). 
+	string serveOn; //Answer queries on this Unix socket, or stdin for "-", until stopped (see server.h). 
+	int processes = 0; //Search in this many worker processes (see shard.h). 
+	bool worker = false; //Be one of those worker processes. 
+	string queueName = "binary";
+	string engineName = "dijkstra";
+	int opt;
+	while ((opt = getopt(argc, argv, "t:q:e:s:w:p:b:xj:m:r:kl:S:Q:i:a:P:WL:B:U:")) != -1) {
+		switch (opt) {
+		case 's':
+			loadSnapshot = optarg;
+			break;
+		case 'w':
+			writeSnapshot = optarg;
+			break;
+		case 'e': //Routing engine: dijkstra, csa or raptor. 
+			engineName = optarg;
+			if (string(optarg) == "dijkstra") engine = DIJKSTRA;
+			else if (string(optarg) == "csa") engine = CONNECTION_SCAN;
+			else if (string(optarg) == "raptor") engine = RAPTOR;
+			else exit(EXIT_FAILURE);
+			break;
+		case 'B': //Origins per batch: 8, 16 or 32. 
+			batch = atoi(optarg);
+			if (batch != 8 && batch != 16 && batch != 32) exit(EXIT_FAILURE);
+			break;
+		case 'x':
+			crossCheck = true;
+			break;
+		case 'p':
+			range = optarg;
+			break;
+		case 'b':
+			transfers = optarg;
+			break;
+		case 'j':
+			statsFile = optarg;
+			break;
+		case 'm':
+			writeMatrix = optarg;
+			break;
+		case 'r':
+			readMatrix = optarg;
+			break;
+		case 'k':
+			keepRoutes = true;
+			break;
+		case 'l':
+			lookup = optarg;
+			keepRoutes = true;
+			break;
+		case 'S':
+			window = atoi(optarg);
+			break;
+		case 'Q':
+			queries = optarg;
+			break;
+		case 'i':
+			patternFile = optarg;
+			break;
+		case 'a':
+			pointQuery = optarg;
+			break;
+		case 'P':
+			processes = atoi(optarg);
+			break;
+		case 'W':
+			worker = true;
+			break;
+		case 'L':
+			serveOn = optarg;
+			break;
+		case 'U':
+			updates = optarg;
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'q': //Priority queue backend: binary, quaternary or radix. 
+			queueName = optarg;
+			if (string(optarg) == "binary") queue = BINARY_HEAP;
+			else if (string(optarg) == "quaternary") queue = QUATERNARY_HEAP;
+			else if (string(optarg) == "radix") queue = RADIX_HEAP;
+			else exit(EXIT_FAILURE);
+			break;
+		default:
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (!statsFile.empty() && (!readMatrix.empty() || window > 0 || (processes > 0 && !worker))) {
+		//These modes never load the whole galaxy in this process, so there are no figures to write. 
+		cerr << "-j cannot be combined with -r, -S or -P" << endl;
+		exit(EXIT_FAILURE);
+	}
+	if (!readMatrix.empty()) {
+		RouteMatrix matrix;
+		if (argc != optind || !matrix.load(readMatrix)) {
+			exit(EXIT_FAILURE);
+		}
+		matrix.print(cout);
+		return 0;
+	}
+	if (window > 0) {
+		if (argc - optind != 2 || queries.empty()) {
+			exit(EXIT_FAILURE);
+		}
+		return runStream(argv[optind], argv[optind + 1], queries, window);
+	}
+	if (processes > 0 && !worker) {
+		//The workers load the schedule; the coordinator only merges their results. 
+		vector<string> command = { argv[0], "-W", "-t", to_string(threads), "-q", queueName, "-e", engineName };
+		if (batch > 0) {
+			command.insert(command.end(), { "-B", to_string(batch) });
+		}
+		if (!updates.empty()) {
+			command.insert(command.end(), { "-U", updates });
+		}
+		if (!loadSnapshot.empty() && argc == optind) {
+			command.insert(command.end(), { "-s", loadSnapshot });
+		}
+		else if (loadSnapshot.empty() && argc - optind == 2) {
+			command.insert(command.end(), { argv[optind], argv[optind + 1] });
+		}
+		else {
+			exit(EXIT_FAILURE);
+		}
+		ShardCoordinator coordinator(command, processes);
+		return coordinator.run();
+	}
+	Galaxy* starWars;
+	if (!loadSnapshot.empty()) {
+		if (argc != optind) {
+			exit(EXIT_FAILURE); 
+		}
+		starWars = Snapshot::load(loadSnapshot);
+		if (!starWars) {
+			exit(EXIT_FAILURE);
+		}
+	}
+	else {
+		if (argc - optind != 2) {
+			exit(EXIT_FAILURE); 
+		}
+		Reader read(argv[optind], argv[optind + 1]);
+		read.threads = threads;
+		starWars = read.load();
+	}
+	if (!updates.empty()) {
+		applyUpdates(starWars, updates);
+	}
+	if (!writeSnapshot.empty() && !Snapshot::write(*starWars, writeSnapshot)) {
+		cerr << "Cannot write snapshot " << writeSnapshot << endl;
+		exit(EXIT_FAILURE);
+	}
+	starWars->threads = threads;
+	starWars->queue = queue;
+	starWars->engine = engine;
+	starWars->batch = batch;
+	if (worker) {
+		return finish(starWars, statsFile, run_shard_worker(*starWars));
+	}
+	if (crossCheck) {
+		int differences = starWars->cross_check();
+		cout << "CROSS-CHECK: " << differences << " DIFFERENCES" << endl;
+		return finish(starWars, statsFile, differences == 0 ? 0 : EXIT_FAILURE);
+	}
     //starWars->dump();
+	if (!range.empty()) {
+		printProfile(starWars, range);
+		return finish(starWars, statsFile, 0);
+	}
+	if (!transfers.empty()) {
+		printJourneys(starWars, transfers);
+		return finish(starWars, statsFile, 0);
+	}
+	if (!patternFile.empty()) {
+		shared_ptr<TransferPatterns> patterns = make_shared<TransferPatterns>();
+		if (!ifstream(patternFile) || !patterns->load(patternFile) || !patterns->matches(*starWars)) {
+			patterns->compute(*starWars);
+			if (!patterns->write(patternFile)) {
+				cerr << "Cannot write transfer patterns " << patternFile << endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+		starWars->patterns = patterns;
+		if (pointQuery.empty() && serveOn.empty()) {
+			return finish(starWars, statsFile, 0);
+		}
+	}
+	if (!serveOn.empty()) {
+		QueryServer server(*starWars);
+		return finish(starWars, statsFile, server.serve(serveOn));
+	}
+	if (!pointQuery.empty()) {
+		printQuery(starWars, pointQuery);
+		return finish(starWars, statsFile, 0);
+	}
+	if (!writeMatrix.empty()) {
+		RouteMatrix matrix;
+		matrix.compute(*starWars);
+		if (!matrix.write(writeMatrix)) {
+			cerr << "Cannot write route matrix " << writeMatrix << endl;
+			exit(EXIT_FAILURE);
+		}
+		return finish(starWars, statsFile, 0);
+	}
+	//Kept routes live next to the schedule they were computed from and are only used while 
+	//they still match it. 
+	string routesFile = (loadSnapshot.empty() ? string(argv[optind + 1]) : loadSnapshot) + ".matrix";
+	if (keepRoutes) {
+		starWars->keep_routes = true;
+		if (ifstream(routesFile)) {
+			shared_ptr<RouteMatrix> matrix = make_shared<RouteMatrix>();
+			if (matrix->load(routesFile) && matrix->matches(*starWars)) {
+				starWars->routes = matrix;
+			}
+		}
+	}
+	if (!lookup.empty()) {
+		if (!starWars->routes) {
+			shared_ptr<RouteMatrix> matrix = make_shared<RouteMatrix>();
+			matrix->compute(*starWars);
+			starWars->routes = matrix;
+			matrix->write(routesFile);
+		}
+		printLookup(starWars, lookup);
+		return finish(starWars, statsFile, 0);
+	}
+	bool computed = keepRoutes && !starWars->routes;
 	starWars->search();
-    return 0;
+	if (computed && !starWars->routes->write(routesFile)) {
+		cerr << "Cannot write route matrix " << routesFile << endl;
+	}
+    return finish(starWars, statsFile, 0);
 }
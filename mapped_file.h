@@ -0,0 +1,42 @@
+// mapped_file.h
+//
+// MappedFile: read-only memory mapping of a whole file.
+//
+// The Reader tokenizes the schedule files in place through
+// std::string_view, so the mapping must outlive every view taken from
+// it.
+
+#if !defined(MAPPED_FILE_H)
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+class MappedFile {
+public:
+	MappedFile() : data_(nullptr), size_(0), open_(false) {}
+	// Maps the named file.  is_open() reports whether that worked; an
+	// empty file is open with size() 0.
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other);
+	MappedFile& operator=(MappedFile&& other);
+
+	bool is_open() const { return open_; }
+	const char* data() const { return data_; }
+	size_t size() const { return size_; }
+	std::string_view view() const { return std::string_view(data_, size_); }
+
+private:
+	void unmap();
+
+	const char* data_;
+	size_t size_;
+	bool open_;
+};
+
+#endif
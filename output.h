@@ -0,0 +1,52 @@
+// output.h
+//
+// RouteWriter: buffered sink for itineraries in the tab-separated leg
+// format of Itinerary::print().
+//
+// One writer stays open for a whole run.  Each itinerary is formatted
+// without iostreams (see Itinerary::format()) into a per-thread buffer
+// and then appended whole to the writer's block under a lock, so
+// search threads may write concurrently without their lines
+// interleaving.  The block goes to the file or stream once it reaches
+// BLOCK_SIZE bytes, on flush() and when the writer is destroyed.  The
+// bytes written are exactly those Itinerary::print() writes.
+
+#if !defined(OUTPUT_H)
+#define OUTPUT_H
+
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include "galaxy.h"
+
+class RouteWriter {
+public:
+	// Writes to a stream, which must outlive the writer.
+	explicit RouteWriter(std::ostream& out);
+	// Writes to a file, truncating it or appending to it.
+	explicit RouteWriter(const std::string& path, bool append = false);
+	~RouteWriter() { flush(); }
+
+	RouteWriter(const RouteWriter&) = delete;
+	RouteWriter& operator=(const RouteWriter&) = delete;
+
+	bool is_open() const { return out.good(); }
+
+	// write() appends the itinerary's legs followed, if separate is
+	// set, by the blank line that ends each itinerary of a listing.
+	void write(const Itinerary& itinerary, const Fleet& fleet, bool separate = true);
+
+	// flush() hands the buffered block to the file or stream.
+	void flush();
+
+	static const size_t BLOCK_SIZE = 1 << 20;
+
+private:
+	std::mutex lock;
+	std::ofstream file;
+	std::ostream& out;
+	std::string block;
+};
+
+#endif
@@ -0,0 +1,127 @@
+// parallel.h
+//
+// parallel_for: work-stealing loop over a range of indices
+// parallel_sort: merge sort of a random-access range on parallel_for
+//
+// Each worker thread starts with an equal, contiguous share of the
+// indices in a deque of its own.  It takes work from the front of its
+// own deque and, once that runs dry, steals from the back of the other
+// workers' deques.  Searches from different origins have very uneven
+// costs, so a static split alone would leave most threads idle at the
+// end of a run.
+
+#if !defined(PARALLEL_H)
+#define PARALLEL_H
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Number of worker threads to use when the caller asks for 0.
+inline int default_threads() {
+	int n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+
+// Call body(worker, index) once for every index in [0, count), using
+// up to `threads` threads (0 means default_threads()).  worker is in
+// [0, threads) and identifies the calling thread, so the body may use
+// it to select per-thread state.  Returns once every index is done.
+template<typename Body>
+void parallel_for(int count, int threads, Body body) {
+	if (threads <= 0) {
+		threads = default_threads();
+	}
+	if (threads > count) {
+		threads = count;
+	}
+	if (threads <= 1) {
+		for (int i = 0; i < count; i++) {
+			body(0, i);
+		}
+		return;
+	}
+
+	struct WorkQueue {
+		std::mutex lock;
+		std::deque<int> items;
+	};
+	std::vector<WorkQueue> queues(threads);
+	for (int w = 0; w < threads; w++) {
+		for (int i = count * w / threads; i < count * (w + 1) / threads; i++) {
+			queues[w].items.push_back(i);
+		}
+	}
+
+	// take(): next index for worker w, from its own queue first and then
+	// from the other workers.  No work is ever added, so once every
+	// queue is seen empty the worker is done.
+	auto take = [&](int w, int& index) {
+		{
+			std::lock_guard<std::mutex> guard(queues[w].lock);
+			if (!queues[w].items.empty()) {
+				index = queues[w].items.front();
+				queues[w].items.pop_front();
+				return true;
+			}
+		}
+		for (int k = 1; k < threads; k++) {
+			WorkQueue& victim = queues[(w + k) % threads];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if (!victim.items.empty()) {
+				index = victim.items.back();
+				victim.items.pop_back();
+				return true;
+			}
+		}
+		return false;
+	};
+
+	auto work = [&](int w) {
+		int index;
+		while (take(w, index)) {
+			body(w, index);
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (int w = 1; w < threads; w++) {
+		pool.emplace_back(work, w);
+	}
+	work(0);
+	for (auto& thread : pool) {
+		thread.join();
+	}
+}
+
+
+// Sort [begin, end) by less using up to `threads` threads (0 means
+// default_threads()).  The range is cut into one run per thread, the
+// runs are sorted concurrently and then merged pairwise, each round of
+// merges running concurrently too.  Like std::sort it is not stable.
+template<typename Iterator, typename Less>
+void parallel_sort(Iterator begin, Iterator end, Less less, int threads = 0) {
+	if (threads <= 0) {
+		threads = default_threads();
+	}
+	long long count = end - begin;
+	int runs = count < 2 * threads ? 1 : threads;
+	auto bound = [&](long long run) { return begin + count * run / runs; };
+	parallel_for(runs, threads, [&](int, int run) {
+		std::sort(bound(run), bound(run + 1), less);
+	});
+	for (int width = 1; width < runs; width *= 2) {
+		parallel_for((runs + 2 * width - 1) / (2 * width), threads, [&](int, int pair) {
+			long long first = 2LL * width * pair;
+			if (first + width < runs) {
+				std::inplace_merge(bound(first), bound(first + width), bound(std::min<long long>(first + 2 * width, runs)), less);
+			}
+		});
+	}
+}
+
+#endif
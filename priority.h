@@ -1,6 +1,7 @@
 // priority.h
 //
-// PriorityQueue: binary heap priority queue
+// Priority queues for the search engines: binary heap, 4-ary heap and
+// monotone radix heap.
 //
 // Copyright 2013 Systems Deployment, LLC
 // Author: Morris Bernstein (morris@systems-deployment.com)
@@ -9,131 +10,217 @@
 #define CSS343_PRIORITY_H
 
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
 #include <vector>
 
 
-// This priority queue implementation stores pointers to Things, using
-// a Compare function object that returns a numeric value <0, =0, or
-// >0 for <, ==, and >.  It is assumed that the Thing class has
-// methods int get_priority() and void set_priority(int).  These hold
-// indices into the priority queue to simplify implementation of the
-// reduce (decrease_key) method.
-template<typename Thing, typename Compare>
-class PriorityQueue {
-public:
-	PriorityQueue(Compare compare) : compare_(compare) {}
+// All queues hold integer node indices in [0, nodes) keyed by a
+// non-negative integer (an arrival time).  Equal keys are ordered by
+// node index, so every backend pops nodes in exactly the same order.
+// They share one interface, which is what the search engines are
+// templated over:
+//
+//   void resize(int nodes)    make room for node indices [0, nodes)
+//   void clear()              remove every node
+//   bool empty()
+//   void push(int node, int key)
+//                             insert node, or lower its key if it is
+//                             already queued
+//   int pop()                 remove and return a node of minimum key
+//
+// The radix heap does not lower keys in place: push() adds another
+// entry and pop() may later return a node a second time with a stale
+// key.  Callers must skip nodes they have already settled.  The radix
+// heap also requires monotone keys: no key pushed may be less than the
+// key most recently popped, which holds for Dijkstra's algorithm.
 
-	// Add a new thing to the priority queue.
-	void push_back(Thing* thing);
+enum QueueKind { BINARY_HEAP, QUATERNARY_HEAP, RADIX_HEAP };
 
-	// Decrease (raise?) the priority of a given Thing.
-	void reduce(Thing* thing);
 
-	// Remove and return the lowest (highest?) priority Thing.  This
-	// differs from std::priority_queue which has separate functions.
-	// Returns NULL if the queue is empty.
-	Thing* pop();
+// Class DaryHeap is an indexed Arity-ary min heap.  position_[node]
+// holds the node's slot in the heap (or -1) to implement push() as
+// decrease-key.  Sifting is iterative and compares keys stored in the
+// heap entries themselves.
+template<int Arity>
+class DaryHeap {
+public:
+	void resize(int nodes) { position_.assign(nodes, -1); data_.clear(); }
+	void clear() {
+		for (auto& entry : data_) {
+			position_[entry.node] = -1;
+		}
+		data_.clear();
+	}
+	bool empty() const { return data_.empty(); }
 
-	bool empty() { return data_.empty(); }
+	void push(int node, int key);
+	int pop();
 
-	Thing* getElement(int index);
-	int getSize() { return data_.size(); }
 private:
-	void swap(int n1, int n2);
-
-	void sift_up(int n);
-	void sift_down(int n);
+	struct Entry {
+		uint64_t key;
+		int node;
+	};
 
-	Compare compare_;
-	std::vector<Thing*> data_;
-};
+	static uint64_t make_key(int node, int key) { return (uint64_t(key) << 32) | unsigned(node); }
 
+	void place(int n, const Entry& entry) {
+		data_[n] = entry;
+		position_[entry.node] = n;
+	}
+	void sift_up(int n, Entry entry);
+	void sift_down(int n, Entry entry);
 
-template<typename Thing, typename Compare>
-void PriorityQueue<Thing, Compare>::swap(int n1, int n2) {
-	Thing* tmp = data_[n1];
-	data_[n1] = data_[n2];
-	data_[n2] = tmp;
-	data_[n1]->set_priority(n1);
-	data_[n2]->set_priority(n2);
-}
+	std::vector<Entry> data_;
+	std::vector<int> position_;
+};
 
+typedef DaryHeap<2> BinaryHeap;
+typedef DaryHeap<4> QuaternaryHeap;
 
-template<typename Thing, typename Compare>
-void PriorityQueue<Thing, Compare>::sift_up(int n) {
-	if (n == 0) {
-		return;
-	}
 
-	int parent = (n + 1) / 2 - 1;
-	if (compare_(data_[parent], data_[n]) > 0) {
-		swap(parent, n);
-		sift_up(parent);
+template<int Arity>
+void DaryHeap<Arity>::sift_up(int n, Entry entry) {
+	while (n > 0) {
+		int parent = (n - 1) / Arity;
+		if (data_[parent].key <= entry.key) {
+			break;
+		}
+		place(n, data_[parent]);
+		n = parent;
 	}
+	place(n, entry);
 }
 
 
-template<typename Thing, typename Compare>
-void PriorityQueue<Thing, Compare>::sift_down(int n) {
-	unsigned left = (n + 1) * 2 - 1;
-	if (left >= data_.size()) {
-		return;
-	}
-	unsigned right = left + 1;
-
-	if (compare_(data_[n], data_[left]) >= 0) {
-		if (right >= data_.size() || compare_(data_[left], data_[right]) <= 0) {
-			swap(n, left);
-			sift_down(left);
+template<int Arity>
+void DaryHeap<Arity>::sift_down(int n, Entry entry) {
+	int size = data_.size();
+	for (;;) {
+		int first = n * Arity + 1;
+		if (first >= size) {
+			break;
 		}
-		else {
-			swap(n, right);
-			sift_down(right);
+		int last = first + Arity < size ? first + Arity : size;
+		int best = first;
+		for (int child = first + 1; child < last; child++) {
+			if (data_[child].key < data_[best].key) {
+				best = child;
+			}
 		}
+		if (entry.key <= data_[best].key) {
+			break;
+		}
+		place(n, data_[best]);
+		n = best;
 	}
-	else if (right < data_.size() && compare_(data_[n], data_[right]) > 0) {
-		swap(n, right);
-		sift_down(right);
-	}
+	place(n, entry);
 }
 
 
-template<typename Thing, typename Compare>
-void PriorityQueue<Thing, Compare>::push_back(Thing* thing) {
-	int n = data_.size();
-	thing->set_priority(n);
-	data_.push_back(thing);
-	sift_up(n);
-}
-
-template<typename Thing, typename Compare>
-void PriorityQueue<Thing, Compare>::reduce(Thing* thing) {
-	int current_priority = thing->get_priority();
-	assert(data_[current_priority] == thing);
-	sift_up(current_priority);
+template<int Arity>
+void DaryHeap<Arity>::push(int node, int key) {
+	Entry entry = { make_key(node, key), node };
+	int n = position_[node];
+	if (n < 0) {
+		n = data_.size();
+		data_.push_back(entry);
+	}
+	else {
+		assert(entry.key <= data_[n].key);
+	}
+	sift_up(n, entry);
 }
 
 
-template<typename Thing, typename Compare>
-Thing* PriorityQueue<Thing, Compare>::pop() {
-	if (data_.size() == 0) {
-		return NULL;
-	}
-	Thing* min = data_[0];
-	data_[0] = *data_.rbegin();
-	data_[0]->set_priority(0);
+template<int Arity>
+int DaryHeap<Arity>::pop() {
+	int min = data_[0].node;
+	position_[min] = -1;
+	Entry last = data_.back();
 	data_.pop_back();
-	sift_down(0);
+	if (!data_.empty()) {
+		sift_down(0, last);
+	}
 	return min;
 }
 
-template<typename Thing, typename Compare>
-inline Thing* PriorityQueue<Thing, Compare>::getElement(int index)
-{
-	return data_[index];
-}
 
+// Class RadixHeap is a monotone radix heap.  Entries live in buckets by
+// the highest bit in which their key differs from the last key popped,
+// so push() is O(1) and pop() redistributes each entry at most once
+// per bit of the key.  Bucket 0 holds the entries whose key equals the
+// last key popped; ties are few, so pop() scans it for the lowest node.
+class RadixHeap {
+public:
+	RadixHeap() : last_(0), size_(0) {}
+
+	void resize(int) { clear(); }
+	void clear() {
+		for (auto& bucket : buckets_) {
+			bucket.clear();
+		}
+		last_ = 0;
+		size_ = 0;
+	}
+	bool empty() const { return size_ == 0; }
+
+	void push(int node, int key) {
+		if (size_ == 0) {
+			last_ = 0;  // An emptied queue starts a new monotone sequence.
+		}
+		assert(unsigned(key) >= last_);
+		Entry entry = { unsigned(key), node };
+		buckets_[bucket(entry.key)].push_back(entry);
+		size_++;
+	}
 
+	int pop() {
+		if (buckets_[0].empty()) {
+			int i = 1;
+			while (buckets_[i].empty()) {
+				i++;
+			}
+			unsigned min = buckets_[i][0].key;
+			for (auto& entry : buckets_[i]) {
+				if (entry.key < min) {
+					min = entry.key;
+				}
+			}
+			last_ = min;
+			for (auto& entry : buckets_[i]) {
+				buckets_[bucket(entry.key)].push_back(entry);
+			}
+			buckets_[i].clear();
+		}
+		std::vector<Entry>& ties = buckets_[0];
+		int best = 0;
+		for (unsigned i = 1; i < ties.size(); i++) {
+			if (ties[i].node < ties[best].node) {
+				best = i;
+			}
+		}
+		int node = ties[best].node;
+		ties[best] = ties.back();
+		ties.pop_back();
+		size_--;
+		return node;
+	}
+
+private:
+	struct Entry {
+		unsigned key;
+		int node;
+	};
+
+	// Bucket b > 0 holds keys whose highest bit differing from last_ is
+	// bit b - 1.
+	int bucket(unsigned key) const { return key == last_ ? 0 : 32 - __builtin_clz(key ^ last_); }
+
+	unsigned last_;
+	int size_;
+	std::vector<Entry> buckets_[33];
+};
 
-#endif
\ No newline at end of file
+#endif
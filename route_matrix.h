@@ -0,0 +1,144 @@
+// route_matrix.h
+//
+// Precomputed all-pairs results.
+//
+// A RouteMatrix holds, for every origin o and destination d of a
+// galaxy, the earliest arrival at d from o (leaving o at hour 0, as in
+// Galaxy::search()) and the last step of that itinerary: the planet
+// it arrives from and the ship and departure time of its final leg.
+// Each origin's predecessors form a tree, so any itinerary is rebuilt
+// by walking back from the destination in O(path length), and the
+// earliest arrival is a single lookup, without searching again.
+//
+// Each of the four is a matrix of 32-bit integers referring to the
+// planet and fleet tables stored alongside.  The matrices are
+// cache-blocked: they are split into TILE x TILE tiles stored one after
+// another (row-major within and between tiles), so the lookups of
+// nearby origins and destinations share cache lines and pages.  The
+// side is padded to a multiple of TILE; padding cells are unreachable.
+//
+// Saved as a file with the layout of binary_io.h and magic "GALAXYAP",
+// the matrix doubles as a compact export of the all-pairs result (the
+// planet and ship names are stored once instead of on every line of
+// AllItineraries.txt).  The arrays are, in order: planet name offsets
+// and characters, ship name offsets and characters, the fingerprint()
+// of the schedule, then the arrival, predecessor, ship and departure
+// matrices.  Unreachable pairs have arrival MAX_TIME and predecessor
+// -1; the diagonal has arrival 0 and predecessor -1.  Loading maps the
+// file and views the matrices in place.
+
+#if !defined(ROUTE_MATRIX_H)
+#define ROUTE_MATRIX_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "galaxy.h"
+#include "mapped_file.h"
+
+class RouteMatrix {
+public:
+	RouteMatrix() : planets(0), padded(0), schedule(0) {}
+
+	// compute() searches from every planet of the galaxy with the
+	// Dijkstra engine on galaxy.threads threads and keeps the results.
+	void compute(const Galaxy& galaxy);
+
+	// start() sizes an empty matrix for the galaxy; set_row() then fills
+	// in the results of a finished search (of either engine) from
+	// origin.  Rows may be set concurrently.
+	void start(const Galaxy& galaxy);
+	template<typename Workspace>
+	void set_row(const Galaxy& galaxy, int origin, const Workspace& search);
+
+	// write() saves the matrix.  Returns false if the file cannot be
+	// written.
+	bool write(const std::string& path) const;
+
+	// load() maps a saved matrix, or prints the reason and returns
+	// false if it is missing or corrupt.
+	bool load(const std::string& path);
+
+	// fingerprint() identifies a galaxy's planets and schedule; a matrix
+	// only answers for the galaxy whose fingerprint() it was built from
+	// (see matches()).
+	static uint64_t fingerprint(const Galaxy& galaxy);
+	bool matches(const Galaxy& galaxy) const { return planets == int(galaxy.planets.size()) && schedule == fingerprint(galaxy); }
+
+	int size() const { return planets; }
+	const std::string& planet_name(int planet) const { return planet_names[planet]; }
+
+	// arrival_time() is the earliest arrival at destination from origin,
+	// or MAX_TIME if it cannot be reached.
+	Time arrival_time(int origin, int destination) const { return arrival[cell(origin, destination)]; }
+
+	// furthest() is the planet Galaxy::search() reports for the origin:
+	// the latest to be reached, the highest index among ties.
+	int furthest(int origin) const;
+
+	// itinerary() rebuilds the itinerary from origin to destination in
+	// the form of Search::make_itinerary().  Returns false if the
+	// destination cannot be reached.
+	bool itinerary(const Galaxy& galaxy, int origin, int destination, Itinerary& schedule) const;
+
+	// format() appends the itinerary from origin to destination in the
+	// format of Itinerary::format(); nothing if it cannot be reached.
+	void format(int origin, int destination, std::string& text) const;
+
+	// print() writes every itinerary, origin by origin and destination
+	// by destination, each followed by a blank line: the contents of
+	// AllItineraries.txt.
+	void print(std::ostream& out) const;
+
+	static const uint32_t VERSION = 2;
+	static const int TILE = 32;
+
+private:
+	size_t cell(int origin, int destination) const {
+		size_t tile = size_t(origin / TILE) * (padded / TILE) + destination / TILE;
+		return tile * TILE * TILE + (origin % TILE) * TILE + destination % TILE;
+	}
+
+	// stops(): the planets of the itinerary from origin to destination,
+	// destination first and origin excluded.  Empty if unreachable.
+	const std::vector<int>& stops(int origin, int destination) const;
+
+	int planets;
+	int padded;
+	uint64_t schedule;
+	std::vector<std::string> planet_names;
+	std::vector<std::string> ship_names;
+	Column<Time> arrival;
+	Column<int> predecessor;
+	Column<Ship_ID> ship;
+	Column<Time> departure;
+	// The file the columns view, after load().
+	MappedFile file;
+};
+
+/*
+Precondition: start() has been called and the search has run from origin
+Postcondition: Row origin holds the search's results
+Writes into the matrices start() allocated; each origin's cells are its own.
+*/
+template<typename Workspace>
+void RouteMatrix::set_row(const Galaxy& galaxy, int origin, const Workspace& search)
+{
+	Time* arrivals = const_cast<Time*>(arrival.data());
+	int* predecessors = const_cast<int*>(predecessor.data());
+	Ship_ID* ships = const_cast<Ship_ID*>(ship.data());
+	Time* departures = const_cast<Time*>(departure.data());
+	for (int destination = 0; destination < planets; destination++) {
+		const Planet* planet = galaxy.planets[destination];
+		Leg leg = search.best_leg(planet);
+		Planet* pred = search.getPred(planet);
+		size_t i = cell(origin, destination);
+		arrivals[i] = leg.arrival_time;
+		predecessors[i] = pred ? pred->index : -1;
+		ships[i] = leg.id;
+		departures[i] = leg.departure_time;
+	}
+}
+
+#endif
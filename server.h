@@ -0,0 +1,109 @@
+// server.h
+//
+// Resident query server.
+//
+// QueryServer keeps a loaded galaxy and answers earliest-arrival
+// queries for as long as it runs, either on standard input and output
+// or for any number of clients of a Unix domain socket.  Requests are
+// lines:
+//
+//   origin<tab>destination<tab>departure hour
+//   STATS
+//
+// and each is answered, in the order the client sent them, by a block
+// of lines ending with a blank line: for a query the line
+// "START: <origin>, END: <destination>, TIME: <arrival>" and the legs
+// of the itinerary in the tab-separated format of Itinerary::format()
+// (or "START: ..., END: ..., UNREACHABLE"), for STATS a line
+// "QUERIES: <answered>, QPS: <per second since start>, P50_US: <us>,
+// P99_US: <us>" over the last LATENCY_WINDOW queries, and otherwise
+// "ERROR: <reason>".
+//
+// The lines waiting on every connection, up to MAX_BATCH, are answered
+// as one batch.  Queries of a batch leaving the same origin at the same
+// time share a single-source search (search(origin, departure)), a
+// query alone in its group gets a point-to-point query, and the groups
+// are spread over galaxy.threads threads with one workspace of the
+// galaxy's engine each.  With transfer patterns attached to the galaxy
+// (see transfer_patterns.h) every query is answered from them instead.
+// A query's latency runs from the batch that read it to its answer.
+
+#if !defined(SERVER_H)
+#define SERVER_H
+
+#include <chrono>
+#include <csignal>
+#include <string>
+#include <vector>
+#include "galaxy.h"
+
+class QueryServer {
+public:
+	explicit QueryServer(const Galaxy& galaxy) : galaxy(galaxy), answered(0) {}
+
+	// serve() answers requests on standard input until it ends when path
+	// is "-", and otherwise on a Unix socket created at path until the
+	// process gets SIGINT or SIGTERM.  Returns the exit status of the
+	// program.
+	int serve(const std::string& path);
+
+	// Requests answered together at most.
+	static const size_t MAX_BATCH = 4096;
+	// Latencies kept for the percentiles of STATS.
+	static const size_t LATENCY_WINDOW = 1 << 16;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// A connection: where its requests come from and its answers go
+	// (the same socket, or standard input and output), the unread part
+	// of its input and the unsent part of its answers.
+	struct Client {
+		int input;
+		int output;
+		bool closed;
+		std::string buffer;
+		std::string reply;
+	};
+	// One request line of a batch and, once answered, its answer.
+	// origin is -1 for a request that is not a query.
+	struct Request {
+		int client;
+		std::string line;
+		int origin;
+		int destination;
+		Time departure;
+		std::string answer;
+	};
+
+	// take() moves the client's complete lines into the batch.
+	void take(int client, std::vector<Request>& batch);
+	// execute() answers the queries of a batch, then the rest.
+	void execute(std::vector<Request>& batch);
+	// answer() answers the queries batch[order[k]], whose groups start at
+	// order[groups[g]], with the given workspaces.
+	template<typename Workspace>
+	void answer(std::vector<Workspace>& workspaces, std::vector<Request>& batch, const std::vector<int>& order,
+		const std::vector<int>& groups);
+	// format() writes the answer to a query.
+	void format(Request& request, Time arrival, const Itinerary* itinerary) const;
+	// send() writes as much of the client's answers as it takes.
+	void send(Client& client);
+	std::string stats() const;
+
+	const Galaxy& galaxy;
+	// One workspace per thread, of the galaxy's engine.
+	std::vector<Search> dijkstra;
+	std::vector<ScanSearch> scan;
+	std::vector<RaptorSearch> raptor;
+	std::vector<Client> clients;
+	Clock::time_point started;
+	uint64_t answered;
+	// The last LATENCY_WINDOW latencies in seconds, as a ring.
+	std::vector<double> latencies;
+
+	static volatile std::sig_atomic_t stopping;
+	static void stop(int) { stopping = 1; }
+};
+
+#endif
@@ -0,0 +1,119 @@
+// shard.h
+//
+// Galaxy::search() spread over worker processes.
+//
+// The coordinator starts a number of worker processes, each running the
+// program with -W and the same schedule, connected to it by a pair of
+// pipes on the worker's standard input and output.  It splits the
+// origin planets into shards of consecutive origins and hands a shard
+// to each idle worker, which searches from every origin of the shard
+// on its own threads (see Galaxy::search(int, int, ...)) and sends back
+// the itinerary to each origin's furthest planet.  Once every shard is
+// in, the coordinator prints exactly what Galaxy::search() would have:
+// the itineraries in planet order, sampleRoute.txt and the planet that
+// cannot be reached, if any.
+//
+// A worker that exits, closes its pipe or sends anything unexpected
+// is killed and replaced, and the shard it held goes back to the queue;
+// the results of a shard only count once the worker has sent all of
+// them.  A shard that fails MAX_ATTEMPTS times, or workers that cannot
+// start at all, make the run fail.
+//
+// The protocol is text lines, so it runs over any byte stream (a
+// remote shell, for one):
+//
+//   worker       READY <planets> <schedule fingerprint>
+//   coordinator  SHARD <first> <last>           origins [first, last)
+//   worker       ORIGIN <origin> <arrival> <text bytes> <name bytes>
+//                followed by the itinerary in the format of
+//                Itinerary::format() and the name of a planet the
+//                origin cannot reach (empty if none); once per origin
+//   worker       DONE <first> <last>
+//
+// Closing the worker's input ends it.  Every worker must report the
+// same fingerprint (see RouteMatrix::fingerprint()), so they all search
+// the same schedule.
+
+#if !defined(SHARD_H)
+#define SHARD_H
+
+#include <deque>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "galaxy.h"
+
+class ShardCoordinator {
+public:
+	// command is the worker's program and arguments, -W included.
+	ShardCoordinator(const std::vector<std::string>& command, int processes)
+		: command(command), processes(processes), planets(-1), schedule(0), done(0) {}
+
+	// run() prints the output of Galaxy::search() and returns the exit
+	// status of the program.
+	int run();
+
+	// Attempts at a shard before giving up.
+	static const int MAX_ATTEMPTS = 3;
+	// Shards per worker process, so faster workers take more of them.
+	static const int SHARDS_PER_WORKER = 4;
+
+private:
+	// What a worker found for one origin.
+	struct Result {
+		Time arrival;
+		std::string text;
+		std::string unreachable;
+	};
+	// A worker process: its pid and pipe ends, the unread part of its
+	// output, the shard it is searching (-1 for none) and the results of
+	// that shard so far.
+	struct Worker {
+		pid_t pid;
+		int input;
+		int output;
+		bool ready;
+		int shard;
+		std::string buffer;
+		std::vector<Result> results;
+	};
+	// Origins [first, last), and how often a worker was given them.
+	struct Shard {
+		int first;
+		int last;
+		int attempts;
+	};
+
+	// spawn() starts a worker; false if it could not be started.
+	bool spawn();
+	// receive() handles the complete messages in a worker's buffer;
+	// false if the worker broke the protocol.
+	bool receive(Worker& worker);
+	// assign() hands the next queued shard to an idle worker; false if
+	// it could not be sent.
+	bool assign(Worker& worker);
+	// retire() ends a worker, putting its shard back in the queue if it
+	// failed.  Returns false if that shard has no attempts left.
+	bool retire(int w, bool failed);
+	// print() writes the results as Galaxy::print() does.
+	int print();
+
+	std::vector<std::string> command;
+	int processes;
+	int planets;
+	uint64_t schedule;
+	std::vector<Worker> workers;
+	std::vector<Shard> shards;
+	// Shards waiting for a worker, and the number done.
+	std::deque<int> queue;
+	int done;
+	// Per origin, filled in once its shard is done.
+	std::vector<Result> results;
+};
+
+// run_shard_worker() is the worker side: it reports READY and answers
+// the coordinator's shards on standard input and output until its
+// input is closed.  Returns the exit status of the program.
+int run_shard_worker(Galaxy& galaxy);
+
+#endif
@@ -0,0 +1,187 @@
+// simd.h
+//
+// first_at_least: search of a sorted int32 column, vectorized
+//
+// The timetables of the compact galaxy are columns of 32-bit times
+// (see LegPool), so "the first leg departing at or after t" is a search
+// of a sorted column.  A galloping search from the front and then a
+// branch-free binary search narrow it to a block of at most SIMD_SPAN
+// elements, and the block is finished by counting the elements below
+// t, eight (AVX2) or four (SSE2) at a time.  A relaxation thus costs a
+// few loads and compares instead of a chain of mispredicted branches.
+//
+// The kernel is picked once at run time from what the processor
+// supports; other processors, and builds with -DGALAXY_SCALAR, use the
+// scalar loop.  Columns need no particular alignment: a timetable
+// starts wherever the previous edge's ended.
+//
+// lanes_below: the same compare over a planet's arrival times in a
+// multi-origin search (see BatchScanSearch), returned as a bit mask of
+// up to 32 lanes, one compare and movemask per eight (AVX2) or four
+// (SSE2) lanes.
+
+#if !defined(SIMD_H)
+#define SIMD_H
+
+#include <cstdint>
+#if !defined(GALAXY_SCALAR) && (defined(__x86_64__) || defined(__i386__))
+#define GALAXY_X86 1
+#include <immintrin.h>
+#endif
+
+
+// Elements left to the counting kernel by the binary search.
+const int SIMD_SPAN = 16;
+
+// Each kernel counts the elements of values[0, n) below t.
+typedef int (*CountKernel)(const int32_t* values, int n, int32_t t);
+
+inline int count_below_scalar(const int32_t* values, int n, int32_t t) {
+	int count = 0;
+	for (int i = 0; i < n; i++) {
+		count += values[i] < t;
+	}
+	return count;
+}
+
+#if defined(GALAXY_X86)
+// The vector kernels subtract each compare's all-ones lanes from a
+// vector of counts and add the lanes up at the end.
+__attribute__((target("sse2")))
+inline int count_below_sse2(const int32_t* values, int n, int32_t t) {
+	const __m128i bound = _mm_set1_epi32(t);
+	__m128i counts = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+		counts = _mm_sub_epi32(counts, _mm_cmplt_epi32(block, bound));
+	}
+	counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, 0x4e));
+	counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, 0xb1));
+	return _mm_cvtsi128_si32(counts) + count_below_scalar(values + i, n - i, t);
+}
+
+__attribute__((target("avx2")))
+inline int count_below_avx2(const int32_t* values, int n, int32_t t) {
+	const __m256i bound = _mm256_set1_epi32(t);
+	__m256i counts = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+		counts = _mm256_sub_epi32(counts, _mm256_cmpgt_epi32(bound, block));
+	}
+	__m128i half = _mm_add_epi32(_mm256_castsi256_si128(counts), _mm256_extracti128_si256(counts, 1));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+	return _mm_cvtsi128_si32(half) + count_below_scalar(values + i, n - i, t);
+}
+#endif
+
+// select_count_below(): the best kernel this processor runs.
+inline CountKernel select_count_below() {
+#if defined(GALAXY_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return count_below_avx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return count_below_sse2;
+	}
+#endif
+	return count_below_scalar;
+}
+
+inline const CountKernel count_below = select_count_below();
+
+// simd_kernel(): which kernel count_below is, for reports.
+inline const char* simd_kernel() {
+#if defined(GALAXY_X86)
+	if (count_below == count_below_avx2) {
+		return "avx2";
+	}
+	if (count_below == count_below_sse2) {
+		return "sse2";
+	}
+#endif
+	return "scalar";
+}
+
+
+// Each lane kernel returns the mask of the values[0, n) below t, bit i
+// for values[i]; n is at most 32.
+typedef uint32_t (*LaneKernel)(const int32_t* values, int n, int32_t t);
+
+inline uint32_t lanes_below_scalar(const int32_t* values, int n, int32_t t) {
+	uint32_t mask = 0;
+	for (int i = 0; i < n; i++) {
+		mask |= uint32_t(values[i] < t) << i;
+	}
+	return mask;
+}
+
+#if defined(GALAXY_X86)
+__attribute__((target("sse2")))
+inline uint32_t lanes_below_sse2(const int32_t* values, int n, int32_t t) {
+	const __m128i bound = _mm_set1_epi32(t);
+	uint32_t mask = 0;
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+		mask |= uint32_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, bound)))) << i;
+	}
+	return i < n ? mask | lanes_below_scalar(values + i, n - i, t) << i : mask;
+}
+
+__attribute__((target("avx2")))
+inline uint32_t lanes_below_avx2(const int32_t* values, int n, int32_t t) {
+	const __m256i bound = _mm256_set1_epi32(t);
+	uint32_t mask = 0;
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+		mask |= uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(bound, block)))) << i;
+	}
+	return i < n ? mask | lanes_below_scalar(values + i, n - i, t) << i : mask;
+}
+#endif
+
+// select_lanes_below(): the best lane kernel this processor runs.
+inline LaneKernel select_lanes_below() {
+#if defined(GALAXY_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return lanes_below_avx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return lanes_below_sse2;
+	}
+#endif
+	return lanes_below_scalar;
+}
+
+inline const LaneKernel lanes_below = select_lanes_below();
+
+
+// first_at_least(): the index of the first of the n sorted values that
+// is at least t, or n if there is none (std::lower_bound).  Searches
+// usually ask for early departures, so it gallops from the front: the
+// blocks it tries double in size until one ends at or after t.
+inline int first_at_least(const int32_t* values, int n, int32_t t) {
+	int low = 0;
+	int high = SIMD_SPAN;
+	while (high < n && values[high - 1] < t) {
+		low = high;
+		high *= 2;
+	}
+	const int32_t* first = values + low;
+	n = (high < n ? high : n) - low;
+	while (n > SIMD_SPAN) {
+		int half = n / 2;
+		first = first[half] < t ? first + half : first;
+		n -= half;
+	}
+	//Too short for a vector: not worth the call. 
+	return first - values + (n < 8 ? count_below_scalar(first, n, t) : count_below(first, n, t));
+}
+
+#endif
@@ -0,0 +1,39 @@
+// snapshot.h
+//
+// Binary galaxy snapshots.
+//
+// A snapshot holds everything the search engines need: the planet name
+// table, the fleet table and every array of the CompactGalaxy.  It is
+// written once after the text schedule has been loaded and validated,
+// and loading it maps the file read-only and points the CompactGalaxy
+// columns straight into the mapping, so startup does no parsing and
+// allocates nothing per edge or leg.
+//
+// The file has the layout of binary_io.h with magic "GALAXYSN".  The
+// arrays are, in order: planet name offsets and characters, ship
+// name offsets and characters, the CompactGalaxy columns, then the
+// conduit keys and travel times that schedule updates check new legs
+// against.  A
+// snapshot with the wrong magic, version or size, a bad checksum or
+// inconsistent arrays is rejected.
+
+#if !defined(SNAPSHOT_H)
+#define SNAPSHOT_H
+
+#include <string>
+#include "galaxy.h"
+
+class Snapshot {
+public:
+	// write() saves a loaded galaxy, including any schedule updates
+	// applied to it.  Returns false if the file cannot be written.
+	static bool write(const Galaxy& galaxy, const std::string& path);
+
+	// load() maps a snapshot and returns the galaxy it holds, or prints
+	// the reason and returns nullptr if it is missing or corrupt.
+	static Galaxy* load(const std::string& path);
+
+	static const uint32_t VERSION = 2;
+};
+
+#endif
@@ -0,0 +1,90 @@
+// stats.h
+//
+// Optional instrumentation of the loader and the search engines.
+//
+// Built with -DGALAXY_STATS, the Reader counts the bytes, lines and
+// legs it parses, every search workspace counts its queue operations,
+// edges, legs and connections scanned, RAPTOR rounds and successful
+// relaxations, and the load and search phases are timed.  Without it
+// STAT_ADD() and PhaseTimer compile to nothing and every figure stays
+// zero, so the hot paths are exactly as without instrumentation.
+//
+// Each workspace keeps its own SearchCounters, so threads never share
+// a counter; Galaxy merges them into Galaxy::stats once a run is done.
+
+#if !defined(STATS_H)
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#if defined(GALAXY_STATS)
+#define STAT_ADD(counter, n) ((counter) += (n))
+#else
+#define STAT_ADD(counter, n) ((void)0)
+#endif
+
+
+// Counters of one or more searches.  A push of a planet already in the
+// queue with a lower key counts as a reduce; a pop of a planet already
+// settled (radix heap only) counts as stale.  legs_examined is the
+// number of non-dominated legs on the edges scanned, i.e. the
+// timetables the lookups searched through.
+struct SearchCounters {
+	uint64_t searches = 0;
+	uint64_t queue_pushes = 0;
+	uint64_t queue_reduces = 0;
+	uint64_t queue_pops = 0;
+	uint64_t stale_pops = 0;
+	uint64_t edges_scanned = 0;
+	uint64_t legs_examined = 0;
+	uint64_t connections_scanned = 0;
+	uint64_t rounds = 0;
+	uint64_t relaxations = 0;
+
+	void merge(const SearchCounters& other);
+};
+
+
+// Counters and wall-clock times, in seconds, of a Galaxy's load and
+// searches.
+struct GalaxyStats {
+	uint64_t bytes_parsed = 0;
+	uint64_t lines_parsed = 0;
+	uint64_t legs_loaded = 0;
+	double conduits_seconds = 0; //Reader: conduits file.
+	double routes_seconds = 0; //Reader: ship routes file and graph.
+	double freeze_seconds = 0; //Building the compact form.
+	double search_seconds = 0; //Galaxy::search(): the searches...
+	double output_seconds = 0; //...and printing their itineraries.
+	SearchCounters search;
+
+	// write_json() writes every figure as one JSON object.
+	void write_json(std::ostream& out) const;
+};
+
+
+// Class PhaseTimer adds the time from its construction to stop() or,
+// if it is not stopped, its destruction to a phase of GalaxyStats.
+class PhaseTimer {
+public:
+#if defined(GALAXY_STATS)
+	explicit PhaseTimer(double& seconds) : seconds(&seconds), start(std::chrono::steady_clock::now()) {}
+	~PhaseTimer() { stop(); }
+	void stop() {
+		if (seconds) {
+			*seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			seconds = nullptr;
+		}
+	}
+private:
+	double* seconds;
+	std::chrono::steady_clock::time_point start;
+#else
+	explicit PhaseTimer(double&) {}
+	void stop() {}
+#endif
+};
+
+#endif
@@ -0,0 +1,153 @@
+// stream.h
+//
+// Streaming schedule ingestion.
+//
+// ScheduleStream answers earliest-arrival queries over a routes file
+// too large to load as a Galaxy.  The file has the format of
+// ship_routes.txt but must be ordered by departure time (for instance
+// sorted with sort -t '<tab>' -k3,3n); it is read in chunks of
+// CHUNK_SIZE bytes and ingested up to a given time, and its legs are
+// validated as they arrive the way the Reader validates them, per ship
+// against the ship's previous leg.
+// Invalid legs are reported on cerr with their line number and
+// skipped.
+//
+// Only the legs that departed within the last `window` hours of the
+// latest departure read are kept.  A search is an incremental
+// Connection Scan (see ScanSearch): started for a departure still in
+// the window, it first scans the resident legs and then each leg as it
+// is read.  It ends once no later leg can improve the arrival at its
+// destination, or unanswered once legs depart more than `window` hours
+// after it.  Memory use is bounded by the window, the planets and ships
+// and the searches in progress, whatever the length of the file.
+
+#if !defined(STREAM_H)
+#define STREAM_H
+
+#include <deque>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "galaxy.h"
+
+class ScheduleStream {
+public:
+	// One leg read from the stream, between planet ids.
+	struct Connection {
+		int source;
+		int destination;
+		Leg leg;
+	};
+
+	// The result of a search: the arrival time (MAX_TIME if the
+	// destination was not reached within the window) and the legs of the
+	// itinerary from the origin on.
+	struct Result {
+		std::string origin;
+		std::string destination;
+		Time departure;
+		Time arrival;
+		std::vector<Connection> legs;
+	};
+
+	explicit ScheduleStream(Time window) : window(window), position(0), line(0), latest(0), invalid_legs(0) {}
+
+	// open() loads the conduits file and opens the routes file.  Returns
+	// false, printing the reason, if either cannot be read.
+	bool open(const std::string& conduits, const std::string& routes);
+
+	// advance() ingests the legs departing before until, reading more of
+	// the routes file as needed, and advances the searches in progress.
+	// Returns false once the whole file has been ingested.
+	bool advance(Time until);
+
+	// search() starts a search from origin at departure to destination
+	// and returns its id, or -1 (printing the reason) if a planet is
+	// unknown or departure is no longer in the window.
+	int search(const std::string& origin, const std::string& destination, Time departure);
+
+	// finish() ends every search in progress, as at the end of the file.
+	void finish();
+	// busy() tells whether any search is in progress.
+	bool busy() const { return !active.empty(); }
+
+	// result() is the result of a search that has ended, or nullptr.
+	const Result* result(int id) const { return results[id].done ? &results[id].result : nullptr; }
+
+	// head() is the latest departure read so far, resident() the number
+	// of legs kept and invalid() the number of legs skipped.
+	Time head() const { return latest; }
+	size_t resident() const { return legs.size(); }
+	int invalid() const { return invalid_legs; }
+
+	const std::string& planet_name(int planet) const { return planet_names[planet]; }
+	const std::string& ship_name(Ship_ID ship) const { return ship_names[ship]; }
+
+	static const size_t CHUNK_SIZE = 1 << 20;
+
+private:
+	// State of a search in progress: per planet the earliest arrival and
+	// the leg arriving then, per ship the planet it takes the traveller
+	// to (-1 if the traveller cannot be aboard).
+	struct Search {
+		int id;
+		int origin;
+		int destination;
+		Time departure;
+		std::vector<Time> arrival;
+		std::vector<Connection> arrived_by;
+		std::vector<int> aboard;
+	};
+
+	struct Slot {
+		bool done;
+		Result result;
+	};
+
+	// Per ship: where and when its last valid leg arrived.
+	struct Ship {
+		int planet;
+		Time arrival;
+	};
+
+	// next_line(): the next complete line of the routes file, reading a
+	// chunk when the buffer runs out.  Returns false at the end of the
+	// file.
+	bool next_line(std::string_view& text);
+	// ingest() validates one line and, if it is a valid leg, keeps it
+	// and advances the searches.
+	void ingest(std::string_view text);
+	// scan() advances a search by one leg; returns false once it has
+	// ended.
+	bool scan(Search& search, const Connection& connection);
+	// end() records a search's result.
+	void end(Search& search);
+
+	int planet(std::string_view name);
+	Ship_ID ship(std::string_view name);
+
+	Time window;
+	std::ifstream in;
+	std::string routes_path;
+	// Read but not yet ingested: pending from position on.
+	std::string pending;
+	size_t position;
+	int line;
+	Time latest;
+	int invalid_legs;
+
+	std::deque<Connection> legs;
+	std::vector<Search> active;
+	std::vector<Slot> results;
+
+	std::unordered_map<std::string, int> planets;
+	std::vector<std::string> planet_names;
+	std::unordered_map<std::string, Ship_ID> ships;
+	std::vector<std::string> ship_names;
+	std::vector<Ship> fleet;
+	// Travel times, keyed by Galaxy::conduit_key() of planet ids.
+	std::unordered_map<uint64_t, Time> conduits;
+};
+
+#endif
@@ -0,0 +1,98 @@
+// transfer_patterns.h
+//
+// Precomputed transfer patterns for point-to-point queries.
+//
+// A journey's pattern is the sequence of edges it flies along, without
+// the legs or times.  For a fixed pair of planets, only a handful of
+// patterns are ever optimal over a whole schedule, so knowing which
+// one is optimal for a departure time turns a query into a walk of one
+// pattern: a lookup of the earliest catchable leg in each of its edge
+// timetables (see CompactGalaxy::earliest_arrival()), with
+// TRANSFER_TIME at every planet in between.  That is a few microseconds
+// instead of a search.  Since staying aboard costs no less than
+// changing ships (TURNAROUND_TIME >= TRANSFER_TIME), every planet on the
+// way counts as a transfer, and patterns are sequences of edges.
+//
+// compute() runs one profile scan per destination, as ProfileSearch
+// does, over the whole schedule: each planet gains the journeys to the
+// destination that no other beats by leaving no earlier and arriving
+// no later.  A journey continues with a journey of the planet its
+// first leg reaches, so its pattern is that edge followed by the
+// other's pattern, and the patterns to a destination form a tree of
+// nodes (edge, next node) shared by every origin.  The answer for a
+// traveller ready at time t is the journey leaving first at or after t,
+// so each pair keeps its journeys' patterns as runs in departure order:
+// the pattern, and the latest departure it is optimal for.  Walking that
+// pattern from t arrives when the journey does, since every leg of a
+// timetable that leaves later also arrives no earlier.
+//
+// Saved as a file with the layout of binary_io.h and magic "GALAXYTP".
+// The arrays are, in order: the fingerprint() of the schedule and the
+// number of edges of the compact galaxy it was built over, the run
+// offsets of each pair (destination-major: pair d * V + o), the runs'
+// last departures and patterns, and the nodes' edges and next nodes
+// (-1 after the edge reaching the destination).  Loading maps the file
+// and views the arrays in place.
+
+#if !defined(TRANSFER_PATTERNS_H)
+#define TRANSFER_PATTERNS_H
+
+#include <cstdint>
+#include <string>
+#include "galaxy.h"
+#include "mapped_file.h"
+
+class TransferPatterns {
+public:
+	TransferPatterns() : planets(0), edges(0), schedule(0) {}
+
+	// compute() scans the schedule once per destination of the galaxy,
+	// on galaxy.threads threads, and keeps the patterns.
+	void compute(const Galaxy& galaxy);
+
+	// write() saves the patterns.  Returns false if the file cannot be
+	// written.
+	bool write(const std::string& path) const;
+
+	// load() maps saved patterns, or prints the reason and returns false
+	// if they are missing or corrupt.
+	bool load(const std::string& path);
+
+	// Patterns only answer for the schedule they were computed from
+	// (see RouteMatrix::fingerprint()).
+	bool matches(const Galaxy& galaxy) const;
+
+	// query() returns the earliest arrival at destination for a
+	// traveller ready to leave origin at the given departure time, or
+	// MAX_TIME if it cannot be reached, as Search::query() does, and
+	// fills the itinerary in the form of Search::make_itinerary()
+	// after it.  The galaxy must be the one the patterns match().
+	Time query(const Galaxy& galaxy, int origin, int destination, Time departure, Itinerary& itinerary) const;
+
+	// Sizes, for reports: the runs of every pair, the distinct patterns
+	// and the bytes held by the arrays.
+	size_t runs() const { return run_until.size(); }
+	size_t patterns() const { return node_edge.size(); }
+	size_t bytes() const;
+
+	static const uint32_t VERSION = 1;
+
+private:
+	size_t pair(int origin, int destination) const { return size_t(destination) * planets + origin; }
+
+	int planets;
+	int edges;
+	uint64_t schedule;
+	// The runs of pair p are [run_begin[p], run_begin[p + 1]): pattern
+	// run_pattern[r] is optimal for the departures after the previous
+	// run's up to run_until[r].
+	Column<uint32_t> run_begin;
+	Column<Time> run_until;
+	Column<int> run_pattern;
+	Column<int> node_edge;
+	Column<int> node_next;
+	// The file the columns view, after load().
+	MappedFile file;
+};
+
+#endif